@@ -0,0 +1,324 @@
+// Per-stage and end-to-end benchmarks on synthetic lane frames, so no video is needed.
+//
+//   canny_lane_tracker_bench --benchmark_out=results.json --benchmark_out_format=json
+//
+// Arguments are {height, clutter} or {height, clutter, sigma * 10}. Heights pick 480p, 720p,
+// 1080p or 4K at 16:9 (640x480 for 480p); clutter is the number of distractor patches and
+// drives edge density. Stage benchmarks run over the lower image region only, like the detector.
+#include <benchmark/benchmark.h>
+#include <map>
+#include <tuple>
+#include "canny_edge_detection.h"
+#include "canny_kernels.h"
+#include "hough_accumulator.h"
+#include "hough_transform.h"
+#include "particle_filter.h"
+#include "pyramid.h"
+#include "synthetic_lanes.h"
+
+namespace {
+
+SyntheticLaneConfig sceneFor(int height, int clutter) {
+    SyntheticLaneConfig scene;
+    scene.height = height;
+    scene.width = height == 480 ? 640 : height * 16 / 9;
+    scene.clutter = clutter;
+    return scene;
+}
+
+// Generating a 4K frame takes longer than most of the stages, so every scene is made once.
+// The benchmarks only read the views.
+FrameView sceneFrame(int height, int clutter) {
+    static std::map<std::pair<int, int>, Frame> frames;
+    auto it = frames.find({height, clutter});
+    if (it == frames.end()) {
+        it = frames.emplace(std::make_pair(height, clutter), makeSyntheticLaneFrame(sceneFor(height, clutter))).first;
+    }
+    return it->second;
+}
+
+const Edges& sceneEdges(int height, int clutter) {
+    static std::map<std::pair<int, int>, Edges> edges;
+    auto it = edges.find({height, clutter});
+    if (it == edges.end()) {
+        Edges list;
+        createCannyEdgeDetection()->run(sceneFrame(height, clutter), list);
+        it = edges.emplace(std::make_pair(height, clutter), std::move(list)).first;
+    }
+    return it->second;
+}
+
+// First row of the default ROI, the lower half
+int roiBegin(int width, int height) {
+    return compileRoi(RoiConfig(), width, height).y_begin;
+}
+
+void setPixelsProcessed(benchmark::State& state, const FrameView& frame) {
+    const int y_begin = roiBegin(frame.width, frame.height);
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(frame.width) * (frame.height - y_begin));
+}
+
+// Arguments are {height, sigma * 10, specialized}: the last one picks the kernels built for
+// this kernel size over the generic ones
+void BM_GaussianBlur(benchmark::State& state) {
+    const FrameView frame = sceneFrame(static_cast<int>(state.range(0)), 0);
+    const double sigma = state.range(1) / 10.0;
+    const int kernel_size = gaussianKernelSize(sigma);
+    const auto weights = quantizeGaussianKernel(gaussianKernel1D(sigma, kernel_size));
+    const GaussianRowKernels kernels = state.range(2) ? selectGaussianRowKernels(kernel_size) : selectGaussianRowKernels();
+    Frame tmp(frame.width, frame.height), blur(frame.width, frame.height);
+    std::vector<const uint8_t*> rows(kernel_size);
+    const int half = kernel_size / 2;
+    const int y_begin = std::max(0, roiBegin(frame.width, frame.height));
+
+    for (auto _ : state) {
+        for (int y = std::max(0, y_begin - half); y < frame.height; ++y) {
+            kernels.horizontal(frame.row(y), tmp.row(y), frame.width, weights.data(), kernel_size);
+        }
+        for (int y = y_begin; y < frame.height; ++y) {
+            for (int k = -half; k <= half; ++k) {
+                rows[k + half] = tmp.row(std::clamp(y + k, 0, frame.height - 1));
+            }
+            kernels.vertical(rows.data(), blur.row(y), frame.width, weights.data(), kernel_size);
+        }
+        benchmark::DoNotOptimize(blur.pixels.data());
+    }
+    setPixelsProcessed(state, frame);
+    state.SetLabel(kernels.name);
+}
+
+void BM_Sobel(benchmark::State& state) {
+    const FrameView frame = sceneFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    const SobelRowFn sobel = selectSobelRowKernel();
+    Frame mag(frame.width, frame.height), dir(frame.width, frame.height);
+    const int y_begin = std::max(1, roiBegin(frame.width, frame.height));
+
+    for (auto _ : state) {
+        for (int y = y_begin; y < frame.height - 1; ++y) {
+            sobel(frame.row(y - 1), frame.row(y), frame.row(y + 1), mag.row(y), dir.row(y), frame.width);
+        }
+        benchmark::DoNotOptimize(mag.pixels.data());
+    }
+    setPixelsProcessed(state, frame);
+}
+
+void BM_NonMaximumSuppression(benchmark::State& state) {
+    const FrameView frame = sceneFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    const SobelRowFn sobel = selectSobelRowKernel();
+    Frame mag(frame.width, frame.height), dir(frame.width, frame.height), nms(frame.width, frame.height);
+    const int y_begin = std::max(1, roiBegin(frame.width, frame.height));
+    for (int y = y_begin; y < frame.height - 1; ++y) {
+        sobel(frame.row(y - 1), frame.row(y), frame.row(y + 1), mag.row(y), dir.row(y), frame.width);
+    }
+
+    for (auto _ : state) {
+        for (int y = y_begin + 1; y < frame.height - 1; ++y) {
+            nonMaximumSuppressionRow(mag.row(y - 1), mag.row(y), mag.row(y + 1), dir.row(y), nms.row(y), frame.width);
+        }
+        benchmark::DoNotOptimize(nms.pixels.data());
+    }
+    setPixelsProcessed(state, frame);
+}
+
+void BM_Canny(benchmark::State& state) {
+    const FrameView frame = sceneFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    CannyEdgeConfig config;
+    config.sigma = state.range(2) / 10.0;
+    auto canny = createCannyEdgeDetection(config);
+    Edges edges;
+    for (auto _ : state) {
+        canny->run(frame, edges);
+        benchmark::DoNotOptimize(edges.xs.data());
+    }
+    setPixelsProcessed(state, frame);
+    state.counters["edge_pixels"] = static_cast<double>(edges.size());
+}
+
+// Tiled Canny against the three whole-frame passes, threads 0 runs the latter
+void BM_CannyTiled(benchmark::State& state) {
+    const FrameView frame = sceneFrame(static_cast<int>(state.range(0)), 40);
+    CannyEdgeConfig config;
+    config.tiled = state.range(1) > 0;
+    config.threads = std::max<int>(1, static_cast<int>(state.range(1)));
+    auto canny = createCannyEdgeDetection(config);
+    Edges edges;
+    for (auto _ : state) {
+        canny->run(frame, edges);
+        benchmark::DoNotOptimize(edges.xs.data());
+    }
+    setPixelsProcessed(state, frame);
+}
+
+// Canny restricted to a trapezoid around the lanes, a quarter of the frame
+void BM_CannyRoi(benchmark::State& state) {
+    const FrameView frame = sceneFrame(static_cast<int>(state.range(0)), 40);
+    CannyEdgeConfig config;
+    config.roi = RoiConfig::trapezoid(0.6, 1.0, 0.25, 1.0);
+    auto canny = createCannyEdgeDetection(config);
+    Edges edges;
+    for (auto _ : state) {
+        canny->run(frame, edges);
+        benchmark::DoNotOptimize(edges.xs.data());
+    }
+    setPixelsProcessed(state, frame);
+    state.counters["edge_pixels"] = static_cast<double>(edges.size());
+}
+
+void BM_HoughVoting(benchmark::State& state) {
+    const Edges& edges = sceneEdges(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    HoughAccumulator accumulator;
+    accumulator.configure(HoughTransformConfig(), edges.width, edges.height, roiBegin(edges.width, edges.height));
+    for (auto _ : state) {
+        accumulator.clear();
+        for (size_t i = 0; i < edges.size(); ++i) {
+            accumulator.vote(edges.xs[i], edges.ys[i], 0, accumulator.theta_bins);
+        }
+        benchmark::DoNotOptimize(accumulator.votes.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(edges.size() * accumulator.theta_bins));
+    state.counters["edge_pixels"] = static_cast<double>(edges.size());
+}
+
+void BM_PeakSearch(benchmark::State& state) {
+    const Edges& edges = sceneEdges(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    const HoughTransformConfig config;
+    HoughAccumulator accumulator;
+    accumulator.configure(config, edges.width, edges.height, roiBegin(edges.width, edges.height));
+    for (size_t i = 0; i < edges.size(); ++i) {
+        accumulator.vote(edges.xs[i], edges.ys[i], 0, accumulator.theta_bins);
+    }
+    HoughPeakFinder finder;
+    std::vector<HoughLine> peaks;
+    for (auto _ : state) {
+        finder.find(accumulator, config.lineThreshold, config.peakWindow, config.numberOfLines, peaks);
+        benchmark::DoNotOptimize(peaks.data());
+    }
+    state.counters["candidates"] = static_cast<double>(finder.candidates);
+}
+
+// Whole transform on an edge list. Third argument: 0 standard, 1 progressive.
+void BM_HoughTransform(benchmark::State& state) {
+    const Edges& edges = sceneEdges(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    const HoughTransformType type = state.range(2) ? HoughTransformType::Progressive : HoughTransformType::Standard;
+    auto hough = createHoughTransform(HoughTransformConfig(), type);
+    for (auto _ : state) {
+        hough->run(edges);
+        benchmark::DoNotOptimize(hough->getDetectedLines().data());
+    }
+    state.counters["edge_pixels"] = static_cast<double>(edges.size());
+    state.counters["votes_cast"] = static_cast<double>(hough->getStats().votes_cast);
+}
+
+// Canny and Hough back to back, what the pipeline's detector stages do per frame
+void BM_ProcessFrame(benchmark::State& state) {
+    const FrameView frame = sceneFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    CannyEdgeConfig canny_config;
+    canny_config.sigma = state.range(2) / 10.0;
+    auto canny = createCannyEdgeDetection(canny_config);
+    auto hough = createHoughTransform();
+    Edges edges;
+    for (auto _ : state) {
+        canny->run(frame, edges);
+        hough->run(edges);
+        benchmark::DoNotOptimize(hough->getDetectedLines().data());
+    }
+    setPixelsProcessed(state, frame);
+    state.counters["edge_pixels"] = static_cast<double>(edges.size());
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+}
+
+// Canny and Hough with the edge budget, args {height, clutter, budget}; budget 0 is the
+// fixed thresholds. Hough time should stay flat as clutter grows.
+void BM_ProcessFrameEdgeBudget(benchmark::State& state) {
+    const FrameView frame = sceneFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    CannyEdgeConfig canny_config;
+    canny_config.edge_budget = static_cast<int>(state.range(2));
+    auto canny = createCannyEdgeDetection(canny_config);
+    auto hough = createHoughTransform();
+    Edges edges;
+    for (auto _ : state) {
+        canny->run(frame, edges);
+        hough->run(edges);
+        benchmark::DoNotOptimize(hough->getDetectedLines().data());
+    }
+    setPixelsProcessed(state, frame);
+    state.counters["edge_pixels"] = static_cast<double>(edges.size());
+    state.counters["high_threshold"] = canny->getStats().high_threshold;
+}
+
+// Pyramid mode: downscale, detect, refine at full resolution. Factor 1 is the plain frame.
+void BM_ProcessFramePyramid(benchmark::State& state) {
+    const FrameView frame = sceneFrame(static_cast<int>(state.range(0)), 40);
+    PyramidConfig pyramid;
+    pyramid.factor = static_cast<int>(state.range(1));
+    CannyEdgeConfig canny_config;
+    canny_config.skip_blur_border = pyramid.factor > 1;
+    auto canny = createCannyEdgeDetection(canny_config);
+    auto hough = createHoughTransform();
+    LineRefiner refiner(pyramid);
+    Frame small(frame.width / pyramid.factor, frame.height / pyramid.factor);
+    Edges edges;
+    std::vector<HoughLine> lines;
+    std::vector<HoughSegment> segments;
+    for (auto _ : state) {
+        if (pyramid.factor > 1) {
+            downscaleFrame(frame, small, pyramid.factor);
+            canny->run(small, edges);
+        } else {
+            canny->run(frame, edges);
+        }
+        hough->run(edges);
+        lines = hough->getDetectedLines();
+        if (pyramid.factor > 1) refiner.refine(frame, hough->getRoi(), lines, segments);
+        benchmark::DoNotOptimize(lines.data());
+    }
+    setPixelsProcessed(state, frame);
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+}
+
+// Arguments are {particles, threads}, on 1080p edges. Seeded once from the Hough lines, so
+// every iteration is a tracking step: predict, score, resample.
+void BM_ParticleFilter(benchmark::State& state) {
+    const Edges& edges = sceneEdges(1080, 40);
+    ParticleFilterConfig config;
+    config.particles = static_cast<int>(state.range(0));
+    config.threads = static_cast<int>(state.range(1));
+    auto tracker = createParticleFilter(config);
+    auto hough = createHoughTransform();
+    hough->run(edges);
+    if (!tracker->seed(hough->getDetectedLines(), edges.width, edges.height)) {
+        state.SkipWithError("no lane boundaries to seed from");
+        return;
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tracker->run(edges).confidence);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["confidence"] = tracker->getState().confidence;
+}
+
+const std::vector<int64_t> kHeights = {480, 720, 1080, 2160};
+const std::vector<int64_t> kClutter = {0, 40, 200};
+const std::vector<int64_t> kSigmaTenths = {10, 20, 30};
+// One sigma per kernel size from 3 to 15 taps
+const std::vector<int64_t> kBlurSigmaTenths = {5, 14, 20, 30, 35, 40, 50};
+
+}
+
+BENCHMARK(BM_GaussianBlur)->ArgsProduct({kHeights, kSigmaTenths, {1}})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_GaussianBlur)->ArgsProduct({{1080}, kBlurSigmaTenths, {0, 1}})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Sobel)->ArgsProduct({kHeights, {0}})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_NonMaximumSuppression)->ArgsProduct({kHeights, kClutter})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Canny)->ArgsProduct({kHeights, kClutter, {20}})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Canny)->ArgsProduct({{1080}, {40}, kSigmaTenths})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_CannyTiled)->ArgsProduct({kHeights, {0, 1, 2, 4}})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_CannyRoi)->ArgsProduct({kHeights})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ProcessFrameEdgeBudget)->ArgsProduct({{1080}, kClutter, {0, 12000}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ProcessFramePyramid)->ArgsProduct({{1080, 2160}, {1, 2, 4}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ParticleFilter)->ArgsProduct({{1024, 4096, 16384}, {1, 2, 4}})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_HoughVoting)->ArgsProduct({kHeights, kClutter})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_PeakSearch)->ArgsProduct({kHeights, kClutter})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_HoughTransform)->ArgsProduct({kHeights, kClutter, {0, 1}})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ProcessFrame)->ArgsProduct({kHeights, kClutter, {20}})->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,54 @@
+// Hough voting speedup over votingThreads = 1, 2, 4, 8 on a synthetic 1080p frame.
+// Also checks that every thread count detects exactly the same lines.
+//
+//   hough_scaling_bench [iterations]
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "canny_edge_detection.h"
+#include "hough_transform.h"
+#include "synthetic_lanes.h"
+
+int main(int argc, char** argv) {
+    const int iterations = argc > 1 ? std::stoi(argv[1]) : 50;
+
+    SyntheticLaneConfig scene;
+    scene.clutter = 40;
+    Frame frame = makeSyntheticLaneFrame(scene);
+    Edges edges;
+    createCannyEdgeDetection()->run(frame, edges);
+    std::cout << "1080p synthetic frame, " << edges.size() << " edge pixels, " << iterations << " iterations" << std::endl;
+
+    double baseline_ms = 0.0;
+    std::vector<HoughLine> reference;
+    for (int threads : {1, 2, 4, 8}) {
+        HoughTransformConfig config;
+        config.votingThreads = threads;
+        auto hough = createHoughTransform(config);
+        hough->run(edges); // warm-up, sizes the accumulator
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            hough->run(edges);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+        const auto& lines = hough->getDetectedLines();
+        bool identical = true;
+        if (threads == 1) {
+            baseline_ms = ms;
+            reference = lines;
+        } else {
+            identical = lines.size() == reference.size();
+            for (size_t i = 0; identical && i < lines.size(); ++i) {
+                identical = identical && lines[i].votes == reference[i].votes &&
+                            lines[i].rho == reference[i].rho && lines[i].theta == reference[i].theta;
+            }
+        }
+        std::cout << threads << " threads: " << ms << " ms/frame, speedup " << baseline_ms / ms
+                  << (identical ? "" : "  MISMATCH vs 1 thread") << std::endl;
+        if (!identical) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "canny_edge_detection.h"
+#include "hough_transform.h"
+#include "pyramid.h"
+#include "video_service.h"
+#include <string>
+#include <vector>
+
+enum class LineOutputFormat {
+    // frame,line,votes,rho,theta,x0,y0,x1,y1 with empty endpoints for infinite lines
+    Csv,
+    // "CLTL" magic and a uint32 version, then per frame a uint32 frame index and a uint32
+    // line count followed by that many {float votes, rho, theta; int16 x0, y0, x1, y1}
+    // records in host byte order. Endpoints are -1 for infinite lines.
+    Binary,
+};
+
+// Headless processing of many recordings. Each stream owns its own detectors and works
+// through the video list on a shared thread pool, one video at a time.
+struct BatchConfig {
+    // Video files, directories (every video file inside, sorted) or .txt lists with one path per line
+    std::vector<std::string> inputs;
+    // One line file per video, named after the video
+    std::string output_dir = ".";
+    LineOutputFormat format = LineOutputFormat::Csv;
+    // Videos processed at once, 0 uses every hardware thread
+    int streams = 0;
+    // Seconds between aggregate progress lines, 0 turns them off
+    double report_interval = 5.0;
+
+    // The streams already use every core, so leave video.prefetch_frames at 0, canny.threads
+    // and hough.votingThreads at 1
+    VideoServiceConfig video;
+    CannyEdgeConfig canny;
+    HoughTransformConfig hough;
+    HoughTransformType hough_type = HoughTransformType::Standard;
+    // Detect on downscaled frames, lines are still written at full resolution
+    PyramidConfig pyramid;
+};
+
+struct BatchStats {
+    size_t videos = 0;
+    size_t failed = 0; // could not be opened or written
+    size_t frames = 0;
+    double seconds = 0.0;
+};
+
+// Expands config.inputs into the list of videos to process
+std::vector<std::string> collectBatchVideos(const std::vector<std::string>& inputs);
+BatchStats runBatch(const BatchConfig& config);
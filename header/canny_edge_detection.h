@@ -1,17 +1,60 @@
 #pragma once
 #include "types.h"
+#include "region_of_interest.h"
 #include <memory>
 
 struct CannyEdgeConfig {
     double high_threshold = 150.0;
     double low_threshold = 100.0;
     double sigma = 2.0;
+    // SIMD blur and Sobel picked by CPU dispatch; false runs the float reference blur
+    // and the scalar Sobel
+    bool use_simd = true;
+    // Fill Edges::dirs when running into an edge list
+    bool edge_directions = false;
+    // Blur, Sobel and NMS fused into one pass over horizontal bands, each keeping its rows
+    // in small rolling buffers. Same output as the three whole-frame passes. Only used with
+    // use_simd and without edge_directions, which needs the whole blurred frame.
+    bool tiled = true;
+    // Bands run at once by the tiled pass, one per thread
+    int threads = 1;
+    // Edge budget: when above 0, the thresholds are picked every frame so that about this
+    // many pixels survive hysteresis, from a histogram of the NMS output. high_threshold
+    // and low_threshold are then only the starting point and the low/high ratio.
+    int edge_budget = 0;
+    double min_high_threshold = 40.0;
+    double max_high_threshold = 250.0;
+    // Share of the way to a lower threshold covered per frame, so quiet frames after a busy
+    // one don't flicker. Higher thresholds apply at once, the frame would be over budget.
+    double threshold_smoothing = 0.2;
+    // Keep edges half a blur kernel away from the frame border. The blur drops the taps
+    // outside the frame, which darkens the border; on the smooth downscaled frames of
+    // pyramid mode that is enough to turn the border columns into lines.
+    bool skip_blur_border = false;
+    // Edges are only found inside this region. Blur and Sobel also cover the few pixels
+    // around it they need, so results inside match a whole-frame run.
+    RoiConfig roi;
+};
+
+// Per-frame counters from the last run()
+struct CannyEdgeStats {
+    size_t strong_pixels = 0; // NMS survivors at or above high_threshold
+    size_t edge_pixels = 0;   // pixels kept by hysteresis
+    // Thresholds this frame ran with
+    double high_threshold = 0.0;
+    double low_threshold = 0.0;
 };
 
 struct CannyEdgeDetection {
 
     virtual ~CannyEdgeDetection() = default;
-    virtual Frame run(const Frame& frame) = 0;
+    // Writes the edge map (255 on edges, 0 elsewhere) into edge_map, which has to be
+    // the size of frame. Both views may have any stride.
+    virtual void run(const FrameView& frame, FrameView edge_map) = 0;
+    // Same detector, but the kept pixels are appended to a reusable list instead of drawn into a map
+    virtual void run(const FrameView& frame, Edges& edges) = 0;
+
+    virtual const CannyEdgeStats& getStats() const = 0;
 };
 
-std::unique_ptr<CannyEdgeDetection> createCannyEdgeDetection();
\ No newline at end of file
+std::unique_ptr<CannyEdgeDetection> createCannyEdgeDetection(const CannyEdgeConfig& config = CannyEdgeConfig());
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Row kernels behind CannyEdgeDetection. Each kernel has a portable scalar
+// version and, on x86, SSE2/AVX2 versions that are picked at runtime.
+
+// Gaussian weights are stored as fixed point with this many fractional bits, each rounded
+// down. The horizontal pass truncates like the float reference, so it lands on the same
+// level or one below. The vertical pass adds kGaussianRounding, half a level, before the
+// shift, which absorbs that level and the weights' shortfall and keeps the result within
+// one level of the reference.
+constexpr int kGaussianFracBits = 14;
+constexpr int kGaussianRounding = 1 << (kGaussianFracBits - 1);
+
+// Odd tap count covering about 3 sigma, at most 15
+int gaussianKernelSize(double sigma);
+// Normalized float taps, the reference the fixed-point weights are derived from
+std::vector<float> gaussianKernel1D(double sigma, int kernel_size);
+std::vector<std::int16_t> quantizeGaussianKernel(const std::vector<float>& kernel);
+
+// dst[x] = sum of src[x + k - half] * weights[k] over the taps that fall inside the row.
+// Taps outside [0, width) are dropped, same as the float reference.
+using GaussianHorizontalRowFn = void (*)(const std::uint8_t* src, std::uint8_t* dst, int width,
+                                         const std::int16_t* weights, int kernel_size);
+// dst[x] = sum of rows[k][x] * weights[k]. The caller clamps the row pointers at the image border.
+using GaussianVerticalRowFn = void (*)(const std::uint8_t* const* rows, std::uint8_t* dst, int width,
+                                       const std::int16_t* weights, int kernel_size);
+
+struct GaussianRowKernels {
+    GaussianHorizontalRowFn horizontal = nullptr;
+    GaussianVerticalRowFn vertical = nullptr;
+    const char* name = "";
+};
+
+GaussianRowKernels scalarGaussianRowKernels();
+// Best kernels for the CPU we are running on.
+GaussianRowKernels selectGaussianRowKernels();
+// Kernels built for one odd kernel_size up to 15, with the tap count fixed at compile time
+// and mirrored taps folded into one multiply. They need symmetric weights, which
+// quantizeGaussianKernel() always produces, and ignore their kernel_size argument.
+// Other sizes get the generic kernels.
+GaussianRowKernels scalarGaussianRowKernels(int kernel_size);
+GaussianRowKernels selectGaussianRowKernels(int kernel_size);
+
+// Gradient direction sectors stored in the dir buffer. Angles are measured with y
+// pointing up and folded into [0, 180), so sector 1 means gx and gy share a sign.
+enum GradientSector : std::uint8_t {
+    kSector0 = 0,
+    kSector45 = 1,
+    kSector90 = 2,
+    kSector135 = 3,
+};
+
+// Fused 3x3 Sobel for x in [1, width - 1): mag = min(|gx| + |gy|, 255) and dir = GradientSector.
+// The sector comes from comparing |gy| against |gx| * tan(22.5) and |gx| * tan(67.5), no atan2.
+using SobelRowFn = void (*)(const std::uint8_t* above, const std::uint8_t* row, const std::uint8_t* below,
+                            std::uint8_t* mag, std::uint8_t* dir, int width);
+
+SobelRowFn scalarSobelRowKernel();
+SobelRowFn selectSobelRowKernel();
+
+// Non-maximum suppression for x in [1, width - 1): out keeps mag where it is at least both
+// neighbours across the edge (picked by dir), and is 0 elsewhere.
+void nonMaximumSuppressionRow(const std::uint8_t* mag_above, const std::uint8_t* mag_row, const std::uint8_t* mag_below,
+                              const std::uint8_t* dir, std::uint8_t* out, int width);
@@ -0,0 +1,61 @@
+#pragma once
+#include "video_service.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Decoded grey frames on disk, so a clip can be replayed without the decoder. The file is
+// this header, zero padding up to data_offset, then frame_count frames of rows x stride
+// bytes each in host byte order. Only rows [y_begin, y_begin + rows) of a frame are kept.
+struct FrameCacheHeader {
+    char magic[8] = {'C', 'L', 'T', 'F', 'R', 'M', 'S', '\0'};
+    uint32_t version = 1;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t y_begin = 0;
+    uint32_t rows = 0;
+    // Bytes between rows, width rounded up to 64 so every row starts aligned
+    uint32_t stride = 0;
+    uint64_t frame_count = 0;
+    uint64_t frame_size = 0;
+    // Page aligned and at least y_begin rows in, so views of the first frame stay inside the file
+    uint64_t data_offset = 0;
+};
+
+// Files with this extension are opened with the frame cache service by the app and batch mode
+constexpr const char* kFrameCacheExtension = ".frames";
+bool isFrameCachePath(const std::string& path);
+
+class FrameCacheWriter {
+public:
+    // Keeps rows [y_begin, y_end) of every frame, y_end 0 keeps them all
+    bool open(const std::string& path, int width, int height, int y_begin = 0, int y_end = 0);
+    // frame has to be width x height
+    bool write(const FrameView& frame);
+    // Pads the file and writes the frame count; until then the cache reads as empty
+    bool close();
+
+    uint64_t frames() const {
+        return header_.frame_count;
+    }
+
+private:
+    std::ofstream out_;
+    FrameCacheHeader header_;
+    std::vector<uint8_t> row_;
+};
+
+struct FrameCacheConfig {
+    // Plays the clip this many times before reporting the end, for long throughput runs
+    int repeat = 1;
+    // Asks the kernel to read the whole file in at once instead of just ahead of the reader
+    bool preload = false;
+};
+
+// Replays a frame cache from a read-only mapping. getFrame() hands out views straight into
+// the mapping, with no copy and no decoding; they must not be written to. There is no
+// colour frame. Rows outside the cached ones belong to the neighbouring frames or the
+// padding, so a cache of the ROI rows only suits a detector whose ROI, with its blur
+// margin, lies inside them.
+std::unique_ptr<VideoService> createFrameCacheVideoService(const FrameCacheConfig& config = {});
@@ -0,0 +1,28 @@
+#pragma once
+#include "types.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Recycles grey frame buffers instead of allocating one per frame. The pool grows until it
+// holds as many buffers as there are frames in flight, after which acquire() and release()
+// never allocate. Buffers are released from a different thread than they are acquired on
+// in the pipeline, so both calls are locked.
+class FramePool {
+public:
+    // Returns a view of a width x height buffer. Buffers of a different size are reallocated.
+    FrameView acquire(int width, int height);
+    // Hands the buffer behind view back. Views that did not come from this pool are ignored,
+    // and so is releasing a buffer that is already free, so a double release can't hand one
+    // buffer to two frames.
+    void release(const FrameView& view);
+
+    size_t size() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Frame>> buffers_;
+    std::vector<int> free_;
+    // Per buffer, whether it is handed out
+    std::vector<bool> in_use_;
+};
@@ -0,0 +1,109 @@
+#pragma once
+#include "hough_transform.h"
+#include <cstdint>
+#include <vector>
+
+// Flat Hough vote accumulator laid out theta-major: the rho bins of one theta are
+// contiguous, so the votes of one pixel land one per column at a fixed stride.
+// rho bins are found with fixed-point cos/sin tables instead of double math.
+struct HoughAccumulator {
+    // 16-bit counts halve the cache footprint. A bin only collects pixels within rhoStep of
+    // one line, at most (ceil(rhoStep * sqrt 2) + 1) per row or column, so configure() lowers
+    // rho_step below config.rhoStep where that times the longer frame side could pass 65535
+    // (rhoStep above 10 at 4K). Frames longer than 21845 px on a side can still wrap.
+    using Count = std::uint16_t;
+    static constexpr double kMaxCount = 65535.0;
+
+    size_t rho_bins = 0;
+    size_t theta_bins = 0;
+    double rho_min = 0.0;
+    double rho_step = 1.0;
+    std::vector<double> thetas_rad;
+
+    // rho index = (x * cos_q[t] + y * sin_q[t] + rho_offset_q) >> frac_bits
+    int frac_bits = 16;
+    std::vector<std::int32_t> cos_q;
+    std::vector<std::int32_t> sin_q;
+    std::int32_t rho_offset_q = 0;
+
+    // Rows [y_begin, height) can vote. Per theta, only rho bins in
+    // [reach_begin[t], reach_end[t]) are reachable from those rows, the rest stay zero.
+    int y_begin = 0;
+    std::vector<std::int32_t> reach_begin;
+    std::vector<std::int32_t> reach_end;
+
+    std::vector<Count> votes;
+
+    // Rebuilds the tables when the geometry or the config changed. Returns true if it did.
+    // rho_step is config.rhoStep, clamped so that no bin can overflow Count.
+    bool configure(const HoughTransformConfig& config, int width, int height, int first_row);
+    // Zeroes the reachable bins only
+    void clear();
+
+    // Largest rhoStep whose bins can't overflow Count on a width x height frame
+    static double maxRhoStep(int width, int height);
+
+    Count* column(size_t t) {
+        return votes.data() + t * rho_bins;
+    }
+    const Count* column(size_t t) const {
+        return votes.data() + t * rho_bins;
+    }
+    Count at(size_t r, size_t t) const {
+        return votes[t * rho_bins + r];
+    }
+    double rho(size_t r) const {
+        return rho_min + static_cast<double>(r) * rho_step;
+    }
+
+    inline std::int32_t rhoIndex(size_t t, int x, int y) const {
+        return (x * cos_q[t] + y * sin_q[t] + rho_offset_q) >> frac_bits;
+    }
+
+    // One vote in every theta bin of [theta_begin, theta_end)
+    inline void vote(int x, int y, size_t theta_begin, size_t theta_end) {
+        Count* cell = votes.data() + theta_begin * rho_bins;
+        for (size_t t = theta_begin; t < theta_end; ++t, cell += rho_bins) {
+            std::int32_t r = rhoIndex(t, x, y);
+            if (static_cast<size_t>(r) < rho_bins) {
+                ++cell[r];
+            }
+        }
+    }
+
+private:
+    int cached_width_ = -1;
+    int cached_height_ = -1;
+    HoughTransformConfig cached_config_;
+};
+
+// Gathers the non-zero pixels of an edge map inside roi into edges
+void collectEdges(const FrameView& edge_map, const RoiSpans& roi, Edges& edges);
+// edges itself when all of its pixels are inside roi, otherwise the ones that are, copied into scratch
+const Edges& edgesInRoi(const Edges& edges, const RoiSpans& roi, Edges& scratch);
+
+// Finds accumulator cells that are at least threshold and strictly above every other cell in
+// a (2 * radius + 1)^2 window, and keeps the strongest few. A separable max filter (along rho,
+// then across thetas) picks the candidates, so the exact window scan only runs on the handful of
+// cells that equal their window maximum.
+struct HoughPeakFinder {
+    // Writes up to max_peaks lines into peaks, strongest first. peaks keeps its capacity.
+    void find(const HoughAccumulator& acc, int threshold, int radius, size_t max_peaks, std::vector<HoughLine>& peaks);
+
+    // Number of cells that passed the max filter in the last find()
+    size_t candidates = 0;
+
+private:
+    bool isStrictMaximum(const HoughAccumulator& acc, size_t r, size_t t, int radius) const;
+
+    // Per-theta sliding max along rho, same layout as the accumulator
+    std::vector<HoughAccumulator::Count> rho_max_;
+    // Window max for the column being scanned
+    std::vector<HoughAccumulator::Count> window_max_;
+    // Per theta: rho range holding cells at or above the threshold, and the
+    // padded range of rho_max_ that the theta pass reads
+    std::vector<int> hot_begin_;
+    std::vector<int> hot_end_;
+    std::vector<int> filter_begin_;
+    std::vector<int> filter_end_;
+};
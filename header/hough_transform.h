@@ -1,19 +1,91 @@
+#pragma once
 #include "types.h"
+#include "region_of_interest.h"
+#include <memory>
 
 struct HoughTransformConfig {
     int lineThreshold = 50;
     double minTheta = -90.0;
     double maxTheta = 90.0;
     double angleStep = 1.0;
+    // Capped per frame size so that the 16-bit vote counts can't wrap, see HoughAccumulator
     double rhoStep = 1.0;
     int numberOfLines = 5;
+    // Peaks must beat every other cell within this many bins in rho and theta
+    int peakWindow = 3;
+    // Vote only in +-orientedVotingWindow theta bins around each edge's gradient angle.
+    // Needs an Edges list with directions, the dense Frame path always votes all thetas.
+    bool orientedVoting = false;
+    int orientedVotingWindow = 6;
+    // Voting threads. Each one owns a contiguous slice of thetas, so no two threads
+    // ever touch the same bin and the result is identical for any thread count.
+    int votingThreads = 1;
+    // Progressive mode: shortest segment reported and the largest run of
+    // missing pixels bridged while following a line
+    int minLineLength = 30;
+    int maxLineGap = 10;
+    // Temporal tracking (standard transform only): vote only near the previous frame's
+    // lines, within trackingThetaMargin degrees and trackingRhoMargin pixels of each.
+    // A full search runs every trackingRefreshInterval frames, and also when the tracked
+    // search finds fewer than trackingMinLines lines or its strongest line drops below
+    // trackingMinVoteRatio of the previous strongest.
+    bool temporalTracking = false;
+    double trackingThetaMargin = 4.0;
+    double trackingRhoMargin = 20.0;
+    int trackingRefreshInterval = 30;
+    int trackingMinLines = 2;
+    double trackingMinVoteRatio = 0.5;
+    // Only edge pixels inside this region vote
+    RoiConfig roi;
+};
+
+enum class HoughTransformType {
+    // Every edge pixel votes, peaks are read off the full accumulator
+    Standard,
+    // Edge pixels vote in random order, each line is taken out as soon as a bin crosses
+    // lineThreshold and the run stops after numberOfLines segments
+    Progressive,
+};
+
+// Per-frame counters from the last run()
+struct HoughStats {
+    size_t edge_pixels = 0;
+    size_t votes_cast = 0; // accumulator increments
+    size_t peak_candidates = 0; // cells equal to their window max, checked exactly
+    bool tracked = false; // lines came from the window around the previous frame's lines
+
+    // Totals since the transform was created
+    size_t tracking_hits = 0;
+    size_t tracking_fallbacks = 0; // tracked searches that looked weak and were redone in full
+    size_t full_searches = 0;
 };
 
 struct HoughTransform {
     virtual ~HoughTransform() = default;
-    virtual Frame run(const Frame& edges) = 0;
+    // Votes the non-zero pixels of an edge map
+    virtual void run(const FrameView& edges) = 0;
+    // Votes straight from a sparse edge list, skipping the scan for non-zero pixels
+    virtual void run(const Edges& edges) = 0;
 
+    // At most numberOfLines lines: strongest first for the standard transform,
+    // in detection order for the progressive one
     virtual const std::vector<HoughLine>& getDetectedLines() const = 0;
+    // Line segments with endpoints. Only the progressive transform finds these,
+    // the standard one leaves the list empty.
+    virtual const std::vector<HoughSegment>& getDetectedSegments() const = 0;
+    virtual const HoughStats& getStats() const = 0;
+    // ROI compiled for the frame size of the last run()
+    virtual const RoiSpans& getRoi() const = 0;
 };
 
-std::unique_ptr<HoughTransform> createHoughTransform();
\ No newline at end of file
+// Bresenham line into frame, clipped to roi
+void drawLineSegment(const FrameView& frame, const RoiSpans& roi, int x0, int y0, int x1, int y1);
+// Endpoints of line far enough out in both directions to cross a width x height image
+void lineEndpoints(const HoughLine& line, int width, int height, int& x0, int& y0, int& x1, int& y1);
+// Draws the segments of the last run(), or its lines across its ROI when it found
+// no segments. Pixels are set to 255, the rest of frame is left alone.
+void drawDetectedLines(const FrameView& frame, const HoughTransform& hough);
+
+std::unique_ptr<HoughTransform> createHoughTransform(const HoughTransformConfig& config = HoughTransformConfig(),
+                                                     HoughTransformType type = HoughTransformType::Standard);
+std::unique_ptr<HoughTransform> createProgressiveHoughTransform(const HoughTransformConfig& config);
\ No newline at end of file
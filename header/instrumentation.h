@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Stage timings and per-frame counters. Recording is a couple of relaxed atomic adds into a
+// fixed log-linear histogram, so it is safe from any thread and never allocates. Build with
+// -DCANNY_LANE_TRACKER_INSTRUMENTATION=OFF to compile every CLT_* macro away.
+#ifndef CANNY_LANE_TRACKER_INSTRUMENTATION
+#define CANNY_LANE_TRACKER_INSTRUMENTATION 1
+#endif
+
+enum class Metric {
+    // Timings in nanoseconds
+    Decode,
+    GrayConvert,
+    // Pyramid mode: shrinking the frame and refitting the coarse lines
+    Downscale,
+    LineRefine,
+    GaussianSmoothing,
+    SobelFilter,
+    NonMaximumSuppression,
+    Hysteresis,
+    // Tiled Canny, blur to NMS in one pass
+    BlurSobelNms,
+    HoughVoting,
+    PeakSearch,
+    LaneTracking,
+    Render,
+    // Per-frame counts
+    EdgePixels,
+    // Hysteresis thresholds Canny used, they move with the edge budget
+    HighThreshold,
+    LowThreshold,
+    VotesCast,
+    PeaksFound,
+    Count
+};
+
+struct MetricSummary {
+    const char* name = "";
+    bool is_time = false;
+    std::uint64_t count = 0;
+    double mean = 0.0;
+    // Percentiles are bucket midpoints, within about 6% of the true value
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    std::uint64_t max = 0;
+};
+
+// Histogram bucket counts as of the last logMetrics() call given this window
+struct MetricWindow {
+    std::vector<std::uint64_t> buckets;
+};
+
+void recordMetric(Metric metric, std::uint64_t value);
+MetricSummary summarizeMetric(Metric metric);
+void resetMetrics();
+// One line with p50/p95/p99/max of every metric. Without a window it covers everything
+// recorded so far. With one it only covers what was recorded since the last call with that
+// window, and starts the next; the max is then a bucket midpoint like the percentiles.
+void logMetrics(std::ostream& out, MetricWindow* window = nullptr);
+// Every metric as a JSON array of summaries. Returns false if the file can't be written.
+bool writeMetricsJson(const std::string& path);
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Metric metric) : metric_(metric), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        recordMetric(metric_, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Metric metric_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#define CLT_CONCAT_INNER(a, b) a##b
+#define CLT_CONCAT(a, b) CLT_CONCAT_INNER(a, b)
+#if CANNY_LANE_TRACKER_INSTRUMENTATION
+#define CLT_SCOPED_TIMER(metric) ScopedTimer CLT_CONCAT(clt_timer_, __LINE__)(Metric::metric)
+#define CLT_RECORD(metric, value) recordMetric(Metric::metric, static_cast<std::uint64_t>(value))
+#else
+#define CLT_SCOPED_TIMER(metric) ((void)0)
+#define CLT_RECORD(metric, value) ((void)0)
+#endif
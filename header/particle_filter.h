@@ -1,6 +1,56 @@
+#pragma once
 #include "types.h"
+#include "region_of_interest.h"
+#include <memory>
+#include <vector>
 
-struct HoughTransform {
-    virtual ~HoughTransform() = default;
-    virtual Lines run(const Edges& edges) = 0;
-};
\ No newline at end of file
+struct ParticleFilterConfig {
+    // Hypotheses tracked, each one a left and a right lane boundary
+    int particles = 4096;
+    // Scoring threads. Particles are split into fixed chunks with their own random
+    // streams, so the result is identical for any thread count.
+    int threads = 1;
+    // Rows each boundary is scored on, spread evenly over the ROI
+    int sample_rows = 32;
+    // A sample scores exp(-d^2 / (2 distance_sigma^2)) for the horizontal distance d to the
+    // nearest edge pixel in its row, and nothing beyond max_distance
+    double distance_sigma = 2.0;
+    int max_distance = 12;
+    // Particle weight is exp(sharpness * score), with the score a share of the best possible
+    double sharpness = 80.0;
+    // Random walk per frame, in pixels, of a boundary's x at the top and bottom ROI rows
+    double top_noise = 3.0;
+    double bottom_noise = 8.0;
+    // A boundary whose weights rest on an effective n particles gets its next random walk
+    // scaled by 1 + roughening / sqrt(n), so it keeps up with a lane moving faster than the
+    // walk. 0 keeps the walk fixed.
+    double roughening = 3.0;
+    // Spread around the Hough lines the particles are seeded from
+    double seed_top_spread = 4.0;
+    double seed_bottom_spread = 12.0;
+    // Locks once the estimate reaches lock_confidence lock_frames frames in a row and
+    // stays locked until it drops below unlock_confidence
+    double lock_confidence = 0.5;
+    double unlock_confidence = 0.3;
+    int lock_frames = 3;
+    // Frames between full Hough searches while locked, 0 never asks for one
+    int full_search_interval = 30;
+    // Only rows inside this region are sampled
+    RoiConfig roi;
+};
+
+struct ParticleFilter {
+    virtual ~ParticleFilter() = default;
+    // Spreads particles around the strongest left- and right-leaning lines of a full
+    // search. A filter that is tracking well only has a few of its particles moved, so one
+    // bad search can't throw it off. Returns false if lines lacks either side.
+    virtual bool seed(const std::vector<HoughLine>& lines, int width, int height) = 0;
+    // Predicts, weighs every particle against the edges and resamples. Stays unlocked
+    // until seeded for this frame size.
+    virtual const TrackedState& run(const Edges& edges) = 0;
+    virtual const TrackedState& getState() const = 0;
+    // True while unlocked, and every full_search_interval frames while locked
+    virtual bool needsFullSearch() const = 0;
+};
+
+std::unique_ptr<ParticleFilter> createParticleFilter(const ParticleFilterConfig& config = {});
@@ -0,0 +1,56 @@
+#pragma once
+#include "types.h"
+#include "region_of_interest.h"
+#include <vector>
+
+// Coarse-to-fine detection: Canny and Hough run on a frame shrunk by factor, then every
+// line is refitted against the full-resolution frame. Canny needs skip_blur_border on the
+// small frames, their blurred border columns would otherwise come out as lines.
+struct PyramidConfig {
+    // 1 runs everything at full resolution
+    int factor = 1;
+    // Full-resolution pixels searched on each side of a coarse line for its edge
+    int refine_radius = 8;
+    // Smallest grey level step across an edge point
+    int refine_min_gradient = 24;
+    // Lines backed by fewer edge points keep their coarse position
+    int refine_min_points = 20;
+};
+
+// dst[x, y] is the rounded mean of the factor x factor block of src at (x * factor, y * factor).
+// dst has to be src / factor in both directions, leftover rows and columns are dropped.
+void downscaleFrame(const FrameView& src, FrameView dst, int factor);
+
+// Lines and segments found on a downscaled frame, in full-resolution coordinates
+HoughLine upscaleLine(const HoughLine& line, int factor);
+HoughSegment upscaleSegment(const HoughSegment& segment, int factor);
+
+// Moves coarse lines onto the full-resolution edges they came from. Along each line it
+// looks for the strongest grey level step across the line within refine_radius, keeps the
+// steps of the dominant polarity and fits a line through them by total least squares.
+class LineRefiner {
+public:
+    explicit LineRefiner(const PyramidConfig& config = PyramidConfig());
+
+    // lines and segments come from a frame config.factor times smaller than gray, inside
+    // coarse_roi, and are returned at gray's resolution. Segments, when there are any,
+    // pair up with lines and keep their extent; infinite lines are fitted across the ROI.
+    void refine(const FrameView& gray, const RoiSpans& coarse_roi, std::vector<HoughLine>& lines,
+                std::vector<HoughSegment>& segments);
+
+    // The coarse ROI scaled up to the size of the last refine()
+    const RoiSpans& roi() const {
+        return roi_;
+    }
+
+private:
+    // Refits line between the given endpoints, returns false if too few edge points were found
+    bool fit(const FrameView& gray, HoughLine& line, double x0, double y0, double x1, double y1, int radius);
+
+    PyramidConfig config_;
+    RoiSpans roi_;
+    // Edge points of the line being fitted, and the sign of their step
+    std::vector<float> xs_;
+    std::vector<float> ys_;
+    std::vector<int> signs_;
+};
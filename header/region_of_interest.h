@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+
+// Part of the frame the detector looks at, a polygon with corners in fractions of the
+// frame width and height so one config fits every resolution.
+struct RoiPoint {
+    double x = 0.0;
+    double y = 0.0;
+};
+
+struct RoiConfig {
+    // Empty keeps the lower half of the frame
+    std::vector<RoiPoint> polygon;
+
+    // Trapezoid centred on center, from row top to row bottom, with the given widths there
+    static RoiConfig trapezoid(double top, double bottom, double top_width, double bottom_width, double center = 0.5);
+};
+
+// Columns [begin, end) of one row
+struct RowSpan {
+    int begin = 0;
+    int end = 0;
+
+    bool empty() const {
+        return begin >= end;
+    }
+};
+
+// A RoiConfig compiled for one frame size: one span per row, empty outside the polygon.
+// Every row keeps a single span from its leftmost to its rightmost inside pixel, so a
+// concave polygon is filled in row by row.
+struct RoiSpans {
+    int width = 0;
+    int height = 0;
+    // Rows [y_begin, y_end) hold every non-empty span
+    int y_begin = 0;
+    int y_end = 0;
+    std::vector<RowSpan> rows;
+
+    const RowSpan& row(int y) const {
+        return rows[y];
+    }
+    bool contains(int x, int y) const {
+        if (y < y_begin || y >= y_end) return false;
+        const RowSpan& span = rows[y];
+        return x >= span.begin && x < span.end;
+    }
+    // Pixels within dx columns and dy rows of the region, inside the frame
+    RoiSpans dilated(int dx, int dy) const;
+    // Keeps columns [x_begin, x_end) and rows [y_begin, y_end) only
+    RoiSpans clipped(int x_begin, int x_end, int y_begin, int y_end) const;
+    // The same region on a frame factor times larger, width x height
+    RoiSpans upscaled(int factor, int width, int height) const;
+};
+
+RoiSpans compileRoi(const RoiConfig& roi, int width, int height);
+
+// Shrinks the segment to the part between its first and last pixel inside roi.
+// Returns false if no pixel of it is inside.
+bool clipToRoi(const RoiSpans& roi, int& x0, int& y0, int& x1, int& y1);
@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded single-producer single-consumer queue. The storage is allocated once in the
+// constructor; push() and pop() never allocate or lock. Exactly one thread may push and
+// exactly one thread may pop.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : slots_(capacity + 1) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Returns false if the ring is full
+    bool push(const T& value) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t next = advance(head);
+        if (next == tail_.load(std::memory_order_acquire)) return false;
+        slots_[head] = value;
+        head_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the ring is empty
+    bool pop(T& value) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) return false;
+        value = slots_[tail];
+        tail_.store(advance(tail), std::memory_order_release);
+        return true;
+    }
+
+    // Exact from either end, a snapshot from any other thread
+    size_t size() const {
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        return head >= tail ? head - tail : head + slots_.size() - tail;
+    }
+
+    size_t capacity() const {
+        return slots_.size() - 1;
+    }
+
+private:
+    size_t advance(size_t i) const {
+        return i + 1 == slots_.size() ? 0 : i + 1;
+    }
+
+    // One slot always stays empty to tell a full ring from an empty one
+    std::vector<T> slots_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include "types.h"
+
+// Procedural road frames for benchmarks and regression runs, so neither needs a video file.
+struct SyntheticLaneConfig {
+    int width = 1920;
+    int height = 1080;
+    // Grey level spread of the asphalt texture
+    int noise = 12;
+    // Number of bright distractor patches on the road, the knob for edge density
+    int clutter = 0;
+    unsigned seed = 1;
+};
+
+// Left and right lane markings converging on a vanishing point. The lane drifts
+// sideways with frame_index, so consecutive frames behave like a slow lane change.
+Frame makeSyntheticLaneFrame(const SyntheticLaneConfig& config, int frame_index = 0);
+
+// Where makeSyntheticLaneFrame paints the left (side -1) or right (side 1) marking on row y,
+// for rows below the horizon. The dashes of the right one are left out.
+struct SyntheticMarking {
+    double center;
+    double half_width;
+};
+SyntheticMarking syntheticLaneMarking(const SyntheticLaneConfig& config, int frame_index, int side, int y);
@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads for fork-join loops. The calling thread joins in, so a
+// pool of size N runs N tasks at once with N - 1 background threads.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const {
+        return static_cast<int>(workers_.size()) + 1;
+    }
+
+    // Runs fn(i) for every i in [0, tasks) and returns once all of them finished.
+    // Takes the callable by reference, so nothing is allocated per call.
+    template <typename Fn>
+    void parallelFor(int tasks, Fn&& fn) {
+        run(tasks, [](void* context, int i) { (*static_cast<std::remove_reference_t<Fn>*>(context))(i); }, &fn);
+    }
+
+private:
+    using TaskFn = void (*)(void* context, int index);
+
+    void run(int tasks, TaskFn fn, void* context);
+    void workerLoop();
+    void drain();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+
+    // Current job, guarded by mutex_ except for the atomics
+    TaskFn fn_ = nullptr;
+    void* context_ = nullptr;
+    int tasks_ = 0;
+    std::atomic<int> next_{0};
+    std::atomic<int> finished_{0};
+    unsigned generation_ = 0;
+    int active_workers_ = 0;
+    bool stop_ = false;
+};
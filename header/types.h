@@ -1,6 +1,8 @@
 #pragma once
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
 #include <opencv2/opencv.hpp>
 
 struct Frame {
@@ -17,6 +19,13 @@ struct Frame {
         return pixels[y * width + x];
     }
 
+    uint8_t* row(int y) {
+        return pixels.data() + static_cast<size_t>(y) * width;
+    }
+    const uint8_t* row(int y) const {
+        return pixels.data() + static_cast<size_t>(y) * width;
+    }
+
     static Frame fromMat(const cv::Mat& mat) {
         Frame frame(mat.cols, mat.rows);
 
@@ -31,28 +40,108 @@ struct Frame {
         return frame;
     }
 
+    // Converts into an existing frame, which only reallocates when the size changes
+    static void fromMat(const cv::Mat& mat, Frame& frame) {
+        if (frame.width != mat.cols || frame.height != mat.rows) {
+            frame = Frame(mat.cols, mat.rows);
+        }
+        cv::Mat gray(frame.height, frame.width, CV_8UC1, frame.pixels.data());
+        if (mat.channels() == 3) {
+            cv::cvtColor(mat, gray, cv::COLOR_BGR2GRAY);
+        } else {
+            mat.copyTo(gray);
+        }
+    }
+
     static cv::Mat toMat(const Frame& frame) {
         return cv::Mat(frame.height, frame.width, CV_8UC1, const_cast<uint8_t*>(frame.pixels.data()));
     }
 };
 
+// Non-owning view of an 8-bit grey image, over a Frame, a cv::Mat or a FramePool buffer.
+// Rows are stride bytes apart. Copying a view never copies pixels.
+struct FrameView {
+    uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    std::ptrdiff_t stride = 0;
+    // Buffer index in the FramePool that handed out this view, -1 if it came from elsewhere
+    int pool_index = -1;
+
+    FrameView() = default;
+    FrameView(uint8_t* data, int width, int height, std::ptrdiff_t stride)
+        : data(data), width(width), height(height), stride(stride) {}
+    // Only over a frame that may be written to: views hand out writable rows
+    FrameView(Frame& frame)
+        : data(frame.pixels.data()), width(frame.width), height(frame.height), stride(frame.width) {}
+    // mat has to be CV_8UC1
+    explicit FrameView(const cv::Mat& mat)
+        : data(mat.data), width(mat.cols), height(mat.rows), stride(static_cast<std::ptrdiff_t>(mat.step)) {}
+
+    uint8_t* row(int y) const {
+        return data + y * stride;
+    }
+    uint8_t& at(int x, int y) const {
+        return data[y * stride + x];
+    }
+    bool empty() const {
+        return data == nullptr || width == 0 || height == 0;
+    }
+    void fill(uint8_t value) const {
+        for (int y = 0; y < height; ++y) {
+            std::memset(row(y), value, width);
+        }
+    }
+    cv::Mat toMat() const {
+        return cv::Mat(height, width, CV_8UC1, data, static_cast<size_t>(stride));
+    }
+};
+
 using Matrix = std::vector<std::vector<float>>;
-struct Edges {};
+// Sparse edge pixels in structure-of-arrays form. clear() keeps the capacity, so a
+// list that lives across frames stops allocating once it has seen a busy frame.
+struct Edges {
+    int width = 0;
+    int height = 0;
+    std::vector<uint16_t> xs;
+    std::vector<uint16_t> ys;
+    // Gradient angle in whole degrees [0, 180), measured in image coordinates (y down).
+    // This is the Hough theta of the edge's line. Empty unless directions were requested.
+    std::vector<uint8_t> dirs;
+
+    void clear() {
+        xs.clear();
+        ys.clear();
+        dirs.clear();
+    }
+    size_t size() const {
+        return xs.size();
+    }
+    bool hasDirections() const {
+        return !dirs.empty() && dirs.size() == xs.size();
+    }
+};
 struct HoughLine { 
     float votes=0;
     double rho=0;
     double theta=0;
 };
+// Finite piece of a HoughLine, endpoints in pixels
+struct HoughSegment {
+    int x0=0, y0=0;
+    int x1=0, y1=0;
+    float votes=0;
+    double rho=0;
+    double theta=0;
+};
 
-struct TrackedState {};
-
-class ImageMask {
-public:
-    static bool isInLowerRegion(int x, int y, int width, int height) {
-        return y >= height / 2 - 1;
-    }
-
-    static int getMaskStartY(int height) {
-        return height / 2 - 1;
-    }
-};
\ No newline at end of file
+// Lane boundaries estimated by the particle filter, in the coordinates of the edges it saw
+struct TrackedState {
+    // The estimate has held up for a few frames and can stand in for a Hough search
+    bool locked = false;
+    // Share of the sampled rows where the boundaries sit on an edge, 0 to 1
+    float confidence = 0;
+    // votes carries the confidence
+    HoughLine left;
+    HoughLine right;
+};
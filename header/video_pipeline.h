@@ -0,0 +1,121 @@
+#pragma once
+#include "video_service.h"
+#include "canny_edge_detection.h"
+#include "hough_transform.h"
+#include "instrumentation.h"
+#include "particle_filter.h"
+#include "pyramid.h"
+#include "spsc_ring.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class FrameDropPolicy {
+    // Decoding waits for Canny to catch up, every frame gets processed
+    Block,
+    // Frames decoded while Canny's queue is full are dropped, which keeps latency
+    // bounded on live input
+    DropNewest,
+};
+
+struct VideoPipelineConfig {
+    // Decode, Canny and Hough each run on their own thread and render stays on the
+    // calling one (imshow needs it). Off runs the stages back to back on one thread.
+    bool threaded = true;
+    // Frames each queue between two stages can hold
+    int queue_depth = 4;
+    FrameDropPolicy drop_policy = FrameDropPolicy::Block;
+    // Print throughput and stage occupancy every this many processed frames
+    int report_interval = 30;
+    // Show the detections in a window. Off runs headless: no colour copy, no drawing.
+    bool display = true;
+    // Upper bound on the window refresh rate, 0 shows every frame. Frames in between
+    // are still processed, just not drawn, and their colour frame isn't copied.
+    double display_max_fps = 0.0;
+    // Detect on a downscaled frame and refine the lines at full resolution
+    PyramidConfig pyramid;
+};
+
+class VideoPipeline {
+public:
+    VideoPipeline(const VideoPipelineConfig& config, std::unique_ptr<VideoService> video_service,
+                  std::unique_ptr<CannyEdgeDetection> canny_edge_detector,
+                  std::unique_ptr<HoughTransform> hough_transform,
+                  std::unique_ptr<ParticleFilter> lane_tracker = nullptr);
+
+    void run(const std::string& video_path);
+
+private:
+    // Everything one frame needs on its way through the stages. The pipeline owns a fixed
+    // set of these and only passes their indices between threads.
+    struct PipelineFrame {
+        // Borrowed from the video service until the frame has been rendered
+        FrameView gray;
+        // Whether render draws this frame. Decided at decode, so only these frames have
+        // their colour frame copied.
+        bool draw = false;
+        // Decoded colour frame, only filled for frames that are drawn
+        cv::Mat color;
+        // gray shrunk by the pyramid factor, unused without a pyramid
+        Frame small{0, 0};
+        Edges edges;
+        // Copied out of the Hough transform, which moves on to the next frame
+        std::vector<HoughLine> lines;
+        std::vector<HoughSegment> segments;
+    };
+
+    enum Stage { kDecode, kCanny, kHough, kRender, kStageCount };
+
+    struct StageCounters {
+        std::atomic<std::uint64_t> busy_ns{0};
+        std::atomic<std::uint64_t> frames{0};
+        // Input queue fill seen at every pop, summed
+        std::atomic<std::uint64_t> queued{0};
+    };
+
+    using Queue = SpscRing<std::uint32_t>;
+
+    void runSerial();
+    void runThreaded();
+    void decodeLoop(Queue& free_frames, Queue& decoded);
+    template <typename Work>
+    void stageLoop(Stage stage, Queue& input, Queue& output, Work&& work);
+
+    bool decode(PipelineFrame& frame);
+    void detectEdges(PipelineFrame& frame);
+    void detectLines(PipelineFrame& frame);
+    void render(PipelineFrame& frame);
+    void report(size_t queue_depth);
+
+    VideoPipelineConfig config_;
+    std::unique_ptr<VideoService> video_service_;
+    std::unique_ptr<CannyEdgeDetection> canny_edge_detector_;
+    std::unique_ptr<HoughTransform> hough_transform_;
+    // Optional. Once locked its two boundaries replace the Hough search, which then only
+    // runs when the tracker asks for one.
+    std::unique_ptr<ParticleFilter> lane_tracker_;
+    // Only touched from the Hough stage
+    LineRefiner line_refiner_;
+
+    std::vector<PipelineFrame> frames_;
+    StageCounters counters_[kStageCount];
+    std::atomic<std::uint64_t> dropped_{0};
+
+    // Only touched from the decode thread
+    std::chrono::steady_clock::time_point last_display_;
+
+    // Render state, only touched from the render thread
+    cv::Mat canvas_;
+    // Full-resolution copy of the Hough ROI, lines are only drawn inside it
+    RoiSpans roi_;
+
+    // Counter values at the last report
+    std::chrono::steady_clock::time_point report_start_;
+    std::uint64_t reported_busy_ns_[kStageCount] = {};
+    std::uint64_t reported_frames_[kStageCount] = {};
+    std::uint64_t reported_queued_[kStageCount] = {};
+    MetricWindow metric_window_;
+};
@@ -1,15 +1,40 @@
+#pragma once
 #include "types.h"
+#include "region_of_interest.h"
 #include <memory>
 #include <opencv2/opencv.hpp>
 #include <yaml-cpp/yaml.h>
 
+struct VideoServiceConfig {
+    // Take the grey frame from the decoder's luma plane instead of converting BGR. Uses a
+    // GStreamer GRAY8 pipeline when OpenCV has that backend, otherwise asks the default
+    // backend for unconverted frames and reads Y out of the YUV layout that comes back.
+    // Packed 4:2:2 needs a FOURCC naming its byte order. Layouts it can't read, and
+    // backends that only give BGR, are converted as usual. There is no colour frame in
+    // this mode unless the decoder produced BGR anyway.
+    bool luma = false;
+    // Only convert the bounding box of roi, grown by roi_margin pixels, and leave the
+    // rest of the grey frame black. The frame keeps its size, so coordinates don't change.
+    // The margin has to cover the Canny blur radius.
+    bool crop_to_roi = false;
+    RoiConfig roi;
+    int roi_margin = 16;
+    // Decode on a background thread, up to this many frames ahead. 0 decodes in getFrame().
+    // Frames are decoded before anyone asks for their colour, so once the first getFrame()
+    // asks for it, the thread copies the colour frame of every frame.
+    int prefetch_frames = 0;
+};
 
 struct VideoService {
     virtual ~VideoService() = default;
-    virtual cv::Mat getFrame() = 0;
-    virtual void releaseFrame(const cv::Mat& frame) = 0;
+    // Decodes the next frame to grey into a pooled buffer. Returns false once the video
+    // is exhausted. The view stays valid until it is handed back with releaseFrame(),
+    // which may happen on another thread. When color is given, the decoded BGR frame is
+    // also copied into it, reusing its buffer.
+    virtual bool getFrame(FrameView& frame, cv::Mat* color = nullptr) = 0;
+    virtual void releaseFrame(const FrameView& frame) = 0;
     virtual bool initialize(const std::string& video_path) = 0;
     virtual bool hasMoreFrames() = 0;
 };
 
-std::unique_ptr<VideoService> createVideoService();
\ No newline at end of file
+std::unique_ptr<VideoService> createVideoService(const VideoServiceConfig& config = {});
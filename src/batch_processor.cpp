@@ -0,0 +1,228 @@
+#include "batch_processor.h"
+#include "frame_cache.h"
+#include "thread_pool.h"
+#include "video_service.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+bool isVideoFile(const fs::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    for (const char* known : {".mp4", ".avi", ".mkv", ".mov", ".m4v", ".h264", ".h265", ".ts", kFrameCacheExtension}) {
+        if (extension == known) return true;
+    }
+    return false;
+}
+
+// Writes one video's detections in the configured format
+class LineWriter {
+public:
+    LineWriter(const std::string& path, LineOutputFormat format) : format_(format) {
+        out_.open(path, format == LineOutputFormat::Binary ? std::ios::binary : std::ios::out);
+        if (!out_) return;
+        if (format_ == LineOutputFormat::Binary) {
+            const uint32_t version = 1;
+            out_.write("CLTL", 4);
+            write(version);
+        } else {
+            out_ << "frame,line,votes,rho,theta,x0,y0,x1,y1\n";
+        }
+    }
+
+    bool good() const {
+        return static_cast<bool>(out_);
+    }
+
+    void writeFrame(uint32_t frame, const std::vector<HoughLine>& lines, const std::vector<HoughSegment>& segments) {
+        // The progressive transform reports one line per segment, in the same order
+        const bool with_segments = segments.size() == lines.size() && !segments.empty();
+        if (format_ == LineOutputFormat::Binary) {
+            write(frame);
+            write(static_cast<uint32_t>(lines.size()));
+            for (size_t i = 0; i < lines.size(); ++i) {
+                write(lines[i].votes);
+                write(static_cast<float>(lines[i].rho));
+                write(static_cast<float>(lines[i].theta));
+                int16_t ends[4] = {-1, -1, -1, -1};
+                if (with_segments) {
+                    ends[0] = static_cast<int16_t>(segments[i].x0);
+                    ends[1] = static_cast<int16_t>(segments[i].y0);
+                    ends[2] = static_cast<int16_t>(segments[i].x1);
+                    ends[3] = static_cast<int16_t>(segments[i].y1);
+                }
+                out_.write(reinterpret_cast<const char*>(ends), sizeof(ends));
+            }
+            return;
+        }
+        for (size_t i = 0; i < lines.size(); ++i) {
+            out_ << frame << ',' << i << ',' << lines[i].votes << ',' << lines[i].rho << ',' << lines[i].theta;
+            if (with_segments) {
+                out_ << ',' << segments[i].x0 << ',' << segments[i].y0 << ',' << segments[i].x1 << ',' << segments[i].y1 << '\n';
+            } else {
+                out_ << ",,,,\n";
+            }
+        }
+    }
+
+private:
+    template <typename T>
+    void write(const T& value) {
+        out_.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    LineOutputFormat format_;
+    std::ofstream out_;
+};
+
+// Output file per video. Videos that share a file name get their batch index as a prefix.
+std::vector<std::string> outputPaths(const std::vector<std::string>& videos, const BatchConfig& config) {
+    std::map<std::string, int> stem_count;
+    for (const auto& video : videos) {
+        ++stem_count[fs::path(video).stem().string()];
+    }
+    const char* extension = config.format == LineOutputFormat::Binary ? ".lines.bin" : ".lines.csv";
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < videos.size(); ++i) {
+        std::string stem = fs::path(videos[i]).stem().string();
+        if (stem_count[stem] > 1) stem = std::to_string(i) + "_" + stem;
+        paths.push_back((fs::path(config.output_dir) / (stem + extension)).string());
+    }
+    return paths;
+}
+
+}
+
+std::vector<std::string> collectBatchVideos(const std::vector<std::string>& inputs) {
+    std::vector<std::string> videos;
+    for (const auto& input : inputs) {
+        fs::path path(input);
+        std::error_code error;
+        if (fs::is_directory(path, error)) {
+            std::vector<std::string> found;
+            for (const auto& entry : fs::directory_iterator(path, error)) {
+                if (entry.is_regular_file(error) && isVideoFile(entry.path())) {
+                    found.push_back(entry.path().string());
+                }
+            }
+            std::sort(found.begin(), found.end());
+            videos.insert(videos.end(), found.begin(), found.end());
+        } else if (path.extension() == ".txt") {
+            std::ifstream list(input);
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty() && line[0] != '#') videos.push_back(line);
+            }
+        } else {
+            videos.push_back(input);
+        }
+    }
+    return videos;
+}
+
+BatchStats runBatch(const BatchConfig& config) {
+    const std::vector<std::string> videos = collectBatchVideos(config.inputs);
+    const std::vector<std::string> outputs = outputPaths(videos, config);
+    std::error_code error;
+    fs::create_directories(config.output_dir, error);
+
+    int streams = config.streams > 0 ? config.streams : static_cast<int>(std::thread::hardware_concurrency());
+    streams = std::max(1, std::min(streams, static_cast<int>(videos.size())));
+    ThreadPool pool(streams);
+
+    std::atomic<size_t> next_video{0};
+    std::atomic<size_t> finished{0};
+    std::atomic<size_t> failed{0};
+    std::atomic<size_t> frames{0};
+    const auto start = Clock::now();
+    std::atomic<int64_t> last_report_ns{0};
+
+    // Any stream may print progress, whichever first sees the interval elapsed
+    auto maybe_report = [&] {
+        if (config.report_interval <= 0.0) return;
+        const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        int64_t last = last_report_ns.load(std::memory_order_relaxed);
+        if (now_ns - last < static_cast<int64_t>(config.report_interval * 1e9)) return;
+        if (!last_report_ns.compare_exchange_strong(last, now_ns)) return;
+        const double seconds = now_ns / 1e9;
+        std::cout << "Batch: " << finished.load() << "/" << videos.size() << " videos, " << frames.load()
+                  << " frames, " << frames.load() / seconds << " fps over " << streams << " streams" << std::endl;
+    };
+
+    // Pyramid mode runs Canny on downscaled frames, whose blurred border would vote for lines
+    CannyEdgeConfig canny_config = config.canny;
+    if (config.pyramid.factor > 1) canny_config.skip_blur_border = true;
+
+    pool.parallelFor(streams, [&](int) {
+        auto canny = createCannyEdgeDetection(canny_config);
+        auto hough = createHoughTransform(config.hough, config.hough_type);
+        LineRefiner refiner(config.pyramid);
+        const int factor = config.pyramid.factor;
+        Frame small(0, 0);
+        Edges edges;
+        std::vector<HoughLine> lines;
+        std::vector<HoughSegment> segments;
+        for (size_t v = next_video++; v < videos.size(); v = next_video++) {
+            auto video_service = isFrameCachePath(videos[v]) ? createFrameCacheVideoService()
+                                                              : createVideoService(config.video);
+            if (!video_service->initialize(videos[v])) {
+                std::cerr << "Batch: can't open " << videos[v] << std::endl;
+                ++failed;
+                ++finished;
+                continue;
+            }
+            LineWriter writer(outputs[v], config.format);
+            if (!writer.good()) {
+                std::cerr << "Batch: can't write " << outputs[v] << std::endl;
+                ++failed;
+                ++finished;
+                continue;
+            }
+            FrameView frame;
+            uint32_t frame_index = 0;
+            while (video_service->hasMoreFrames() && video_service->getFrame(frame)) {
+                if (factor > 1) {
+                    if (small.width != frame.width / factor || small.height != frame.height / factor) {
+                        small = Frame(frame.width / factor, frame.height / factor);
+                    }
+                    downscaleFrame(frame, small, factor);
+                    canny->run(small, edges);
+                } else {
+                    canny->run(frame, edges);
+                }
+                hough->run(edges);
+                lines.assign(hough->getDetectedLines().begin(), hough->getDetectedLines().end());
+                segments.assign(hough->getDetectedSegments().begin(), hough->getDetectedSegments().end());
+                if (factor > 1) refiner.refine(frame, hough->getRoi(), lines, segments);
+                video_service->releaseFrame(frame);
+                writer.writeFrame(frame_index++, lines, segments);
+                ++frames;
+                maybe_report();
+            }
+            if (!writer.good()) {
+                std::cerr << "Batch: failed writing " << outputs[v] << std::endl;
+                ++failed;
+            }
+            ++finished;
+        }
+    });
+
+    BatchStats stats;
+    stats.videos = videos.size();
+    stats.failed = failed;
+    stats.frames = frames;
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return stats;
+}
@@ -1,11 +1,55 @@
 #include "canny_edge_detection.h"
+#include "canny_kernels.h"
+#include "instrumentation.h"
+#include "thread_pool.h"
+#include <array>
+#include <cstring>
+
+namespace {
+
+using GradientHistogram = std::array<uint32_t, 256>;
+
+// Counts the non-zero values of one NMS row. Most of a row is suppressed, so zero runs
+// are skipped eight pixels at a time.
+void accumulateHistogram(const uint8_t* row, int n, GradientHistogram& histogram) {
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        uint64_t word;
+        std::memcpy(&word, row + x, sizeof(word));
+        if (word == 0) continue;
+        for (int i = 0; i < 8; ++i) ++histogram[row[x + i]];
+    }
+    for (; x < n; ++x) ++histogram[row[x]];
+}
+
+}
+
+// Rolling rows of one band of the tiled pass: the last kernel_size horizontally blurred
+// rows and the last three blurred, magnitude and direction rows, each slot picked by row % size.
+struct CannyBandBuffers {
+    std::vector<uint8_t> tmp;
+    std::vector<uint8_t> blur;
+    std::vector<uint8_t> mag;
+    std::vector<uint8_t> dir;
+    // NMS values of the band's rows, filled when an edge budget is set
+    GradientHistogram histogram;
+
+    void ensure(int w, int kernel_size) {
+        const size_t tmp_size = static_cast<size_t>(w) * kernel_size;
+        const size_t row_size = static_cast<size_t>(w) * 3;
+        if (tmp.size() != tmp_size) tmp.assign(tmp_size, 0);
+        if (blur.size() != row_size) {
+            blur.assign(row_size, 0);
+            // Sobel leaves the first and last column alone, they stay zero like in the full pass
+            mag.assign(row_size, 0);
+            dir.assign(row_size, 0);
+        }
+    }
+};
 
 struct canny_edge_detection_impl : public CannyEdgeDetection {
 
     CannyEdgeConfig config_;
-    // static sobel matrices
-    static const Matrix sobel_x;
-    static const Matrix sobel_y;
     Frame tmp{0,0};
     Frame blur{0,0};
     Frame mag{0,0};
@@ -13,9 +57,43 @@ struct canny_edge_detection_impl : public CannyEdgeDetection {
     Frame nms{0,0};
     std::vector<float> gaussian_kernel;
     int gaussian_kernel_size_ = 0;
+    // Sigma the kernel was built for, negative before the first run
+    double gaussian_sigma_ = -1.0;
+    // Fixed-point copy of gaussian_kernel for the SIMD row kernels
+    std::vector<int16_t> gaussian_weights_;
+    // Specialized for gaussian_kernel_size_, picked along with the weights
+    GaussianRowKernels gaussian_rows_;
+    SobelRowFn sobel_row_;
+    std::vector<const uint8_t*> vertical_rows_;
+    // Spans each pass writes, from the ROI outwards: every pass covers what the next
+    // one reads around its own pixels
+    RoiSpans nms_spans_;
+    RoiSpans gradient_spans_;
+    RoiSpans blur_spans_;
+    RoiSpans tmp_spans_;
+    int spans_kernel_size_ = 0;
+    std::vector<CannyBandBuffers> bands_;
+    std::vector<uint8_t> zero_row_;
+    std::unique_ptr<ThreadPool> pool_;
+    // Hysteresis scratch, sized with the frame so tracking never allocates
+    std::vector<uint64_t> visited_;
+    std::vector<int32_t> stack_;
+    // Edge budget: NMS values of the current frame, the thresholds hysteresis runs with
+    // and how many of the pixels above the low threshold the last frames actually kept
+    GradientHistogram histogram_;
+    double high_threshold_ = -1.0;
+    double low_threshold_ = 0.0;
+    double budget_correction_ = 1.0;
+    CannyEdgeStats stats_;
 
-    // Predifine mask for lower imgage
-    int mask_height = 0;
+    explicit canny_edge_detection_impl(const CannyEdgeConfig& config)
+        : config_(config),
+          sobel_row_(config.use_simd ? selectSobelRowKernel() : scalarSobelRowKernel()) {
+        if (config_.threads > 1) {
+            pool_ = std::make_unique<ThreadPool>(config_.threads);
+        }
+        bands_.resize(std::max(1, config_.threads));
+    }
 
     void ensureBuffers(int w, int h) {
         if (tmp.width != w || tmp.height != h) {
@@ -24,32 +102,114 @@ struct canny_edge_detection_impl : public CannyEdgeDetection {
             mag = Frame(w, h);
             dir = Frame(w, h);
             nms = Frame(w, h);
+            visited_.assign((static_cast<size_t>(w) * h + 63) / 64, 0);
+            // Every pixel is pushed at most once, so this can never overflow
+            stack_.assign(static_cast<size_t>(w) * h, 0);
+            zero_row_.assign(w, 0);
         }
     }
 
-    Frame run(const Frame& frame) override {
+    void ensureSpans(int w, int h) {
+        if (nms_spans_.width == w && nms_spans_.height == h && spans_kernel_size_ == gaussian_kernel_size_) return;
+        // NMS and hysteresis need a neighbour on every side
+        const int border = config_.skip_blur_border ? std::max(1, gaussian_kernel_size_ / 2 + 1) : 1;
+        nms_spans_ = compileRoi(config_.roi, w, h).clipped(border, w - border, border, h - border);
+        gradient_spans_ = nms_spans_.dilated(1, 1).clipped(1, w - 1, 1, h - 1);
+        blur_spans_ = gradient_spans_.dilated(1, 1);
+        tmp_spans_ = blur_spans_.dilated(0, gaussian_kernel_size_ / 2);
+        spans_kernel_size_ = gaussian_kernel_size_;
+    }
+
+    void run(const FrameView& frame, FrameView edge_map) override {
+        detect(frame, &edge_map, nullptr);
+    }
+
+    void run(const FrameView& frame, Edges& edge_list) override {
+        edge_list.clear();
+        edge_list.width = frame.width;
+        edge_list.height = frame.height;
+        detect(frame, nullptr, &edge_list);
+    }
+
+    void detect(const FrameView& frame, const FrameView* edge_map, Edges* edge_list) {
         // Implement Canny edge detection algorithm
         ensureBuffers(frame.width, frame.height);
-        mask_height = frame.height;
-        gaussianSmoothing(frame, blur);
-        sobelFilter(blur, mag, dir);
-        nonMaximumSuppression(mag, dir, nms);
-        return nms;
+        ensureGaussianKernel();
+        ensureSpans(frame.width, frame.height);
+        if (config_.tiled && config_.use_simd && !config_.edge_directions) {
+            CLT_SCOPED_TIMER(BlurSobelNms);
+            tiledBlurSobelNms(frame);
+        } else {
+            {
+                CLT_SCOPED_TIMER(GaussianSmoothing);
+                gaussianSmoothing(frame, blur);
+            }
+            {
+                CLT_SCOPED_TIMER(SobelFilter);
+                sobelFilter(blur, mag, dir);
+            }
+            {
+                CLT_SCOPED_TIMER(NonMaximumSuppression);
+                nonMaximumSuppression(mag, dir, nms);
+            }
+        }
+        chooseThresholds();
+        {
+            CLT_SCOPED_TIMER(Hysteresis);
+            hysteresis(nms, edge_map, edge_list);
+        }
+        updateBudgetCorrection();
+        CLT_RECORD(EdgePixels, stats_.edge_pixels);
+        CLT_RECORD(HighThreshold, std::lround(stats_.high_threshold));
+        CLT_RECORD(LowThreshold, std::lround(stats_.low_threshold));
     }
 
-    void gaussianSmoothing(const Frame& frame, Frame& blur) {
-        // Implement Gaussian smoothing
-        ensureGaussianKernel();
-        int y0 = ImageMask::getMaskStartY(frame.height);
+    void gaussianSmoothing(const FrameView& frame, Frame& blur) {
+        if (config_.use_simd) {
+            gaussianSmoothingFixedPoint(frame, blur);
+        } else {
+            gaussianSmoothingReference(frame, blur);
+        }
+    }
 
+    // Same passes as the reference but on whole rows with 16-bit fixed-point weights.
+    // Stays within one grey level of the reference, see kGaussianRounding.
+    void gaussianSmoothingFixedPoint(const FrameView& frame, Frame& blur) {
+        const int half_size = gaussian_kernel_size_ / 2;
+        for (int y = tmp_spans_.y_begin; y < tmp_spans_.y_end; ++y) {
+            horizontalBlurRow(frame.row(y), tmp.row(y), frame.width, tmp_spans_.row(y));
+        }
 
+        // Border rows are handled by clamping the row pointers, not the pixels
+        vertical_rows_.resize(gaussian_kernel_size_);
+        for (int y = blur_spans_.y_begin; y < blur_spans_.y_end; ++y) {
+            const RowSpan& span = blur_spans_.row(y);
+            if (span.empty()) continue;
+            for (int k = -half_size; k <= half_size; ++k) {
+                vertical_rows_[k + half_size] = tmp.row(std::clamp(y + k, 0, frame.height - 1)) + span.begin;
+            }
+            gaussian_rows_.vertical(vertical_rows_.data(), blur.row(y) + span.begin, span.end - span.begin,
+                                    gaussian_weights_.data(), gaussian_kernel_size_);
+        }
+    }
+
+    // Exact within span: the kernel runs on half a kernel more on each side, so the taps it
+    // drops at its own ends are the ones outside the frame
+    void horizontalBlurRow(const uint8_t* src, uint8_t* dst, int width, const RowSpan& span) {
+        if (span.empty()) return;
+        const int half_size = gaussian_kernel_size_ / 2;
+        const int begin = std::max(0, span.begin - half_size);
+        const int end = std::min(width, span.end + half_size);
+        gaussian_rows_.horizontal(src + begin, dst + begin, end - begin, gaussian_weights_.data(), gaussian_kernel_size_);
+    }
+
+    // Float reference implementation
+    void gaussianSmoothingReference(const FrameView& frame, Frame& blur) {
         //Horizontal pass
         int half_size = gaussian_kernel_size_ / 2;
-        int y_blur_start = std::max(0,y0);
-        int y_tmp_start = std::max(0,y_blur_start-half_size);
-
-        for (int y = y_tmp_start; y < frame.height; ++y) {
-            for (int x = 0; x < frame.width; ++x) {
+        for (int y = tmp_spans_.y_begin; y < tmp_spans_.y_end; ++y) {
+            const RowSpan& span = tmp_spans_.row(y);
+            for (int x = span.begin; x < span.end; ++x) {
                 float sum = 0.0f;
 
                 int x_start  = std::max(0, x - half_size);
@@ -64,9 +224,9 @@ struct canny_edge_detection_impl : public CannyEdgeDetection {
         }
 
         // Vertical pass
-        half_size = gaussian_kernel_size_ / 2;
-        for (int y = y_blur_start; y < frame.height; ++y) {
-            for (int x = 0; x < frame.width; ++x) {
+        for (int y = blur_spans_.y_begin; y < blur_spans_.y_end; ++y) {
+            const RowSpan& span = blur_spans_.row(y);
+            for (int x = span.begin; x < span.end; ++x) {
                 float sum = 0.0f;
                 
                 for (int k = -half_size; k <= half_size; ++k) {
@@ -78,129 +238,259 @@ struct canny_edge_detection_impl : public CannyEdgeDetection {
         }
 
     }
-    int computeKernelSize(double sigma) {
-        int kernel_size = static_cast<int>(std::ceil(3.0 * sigma));
-        if (kernel_size % 2 == 0) kernel_size++; // Ensure odd size
-        kernel_size= std::clamp(kernel_size, 1, 15);
-        return kernel_size;
+    // Two sigmas can share a kernel size but not the weights, so this keys on sigma
+    void ensureGaussianKernel() {
+        if (config_.sigma == gaussian_sigma_) return;
+        gaussian_sigma_ = config_.sigma;
+        gaussian_kernel_size_ = gaussianKernelSize(config_.sigma);
+        gaussian_kernel = gaussianKernel1D(config_.sigma, gaussian_kernel_size_);
+        gaussian_weights_ = quantizeGaussianKernel(gaussian_kernel);
+        gaussian_rows_ = selectGaussianRowKernels(gaussian_kernel_size_);
     }
 
-    void ensureGaussianKernel() {
-        int kernel_size = computeKernelSize(config_.sigma);
-        if (kernel_size != gaussian_kernel_size_) {
-            gaussian_kernel = gaussianKernel1D(config_.sigma, kernel_size);
-            gaussian_kernel_size_ = kernel_size;
+    // Fused integer Sobel: L1 magnitude into mag, GradientSector into dir
+    // The row kernels skip their first and last column, so they start one pixel before each span
+    void sobelFilter(const Frame& frame, Frame& mag, Frame& dir) {
+        for (int y = gradient_spans_.y_begin; y < gradient_spans_.y_end; ++y) {
+            const RowSpan& span = gradient_spans_.row(y);
+            if (span.empty()) continue;
+            const int x = span.begin - 1;
+            sobel_row_(frame.row(y - 1) + x, frame.row(y) + x, frame.row(y + 1) + x, mag.row(y) + x, dir.row(y) + x,
+                       span.end - x + 1);
         }
     }
 
-    std::vector<float> gaussianKernel1D(double sigma, int kernel_size) {
-        std::vector<float> kernel(kernel_size);
-        int half_size = kernel_size / 2;
-        float sum = 0.0f;
-
-        for (int i = -half_size; i <= half_size; ++i) {
-            float value = std::exp(-(i * i) / (2 * sigma * sigma));
-            kernel[i + half_size] = value;
-            sum += value;
+    void nonMaximumSuppression(const Frame& magnitude, const Frame& direction, Frame& nms) {
+        histogram_.fill(0);
+        for (int y = nms_spans_.y_begin; y < nms_spans_.y_end; ++y) {
+            const RowSpan& span = nms_spans_.row(y);
+            if (span.empty()) continue;
+            const int x = span.begin - 1;
+            nonMaximumSuppressionRow(magnitude.row(y - 1) + x, magnitude.row(y) + x, magnitude.row(y + 1) + x,
+                                     direction.row(y) + x, nms.row(y) + x, span.end - x + 1);
+            if (config_.edge_budget > 0) accumulateHistogram(nms.row(y) + span.begin, span.end - span.begin, histogram_);
         }
+    }
 
-        // Normalize the kernel
-        for (auto& value : kernel) {
-            value /= sum;
+    // Splits the NMS rows into one band per thread. Each band streams its rows from the
+    // frame straight to nms, recomputing the few halo rows it shares with its neighbours.
+    void tiledBlurSobelNms(const FrameView& frame) {
+        const int rows = nms_spans_.y_end - nms_spans_.y_begin;
+        if (rows <= 0) return;
+        const int bands = std::min(static_cast<int>(bands_.size()), rows);
+        auto band = [&](int i) {
+            runBand(frame, nms_spans_.y_begin + rows * i / bands, nms_spans_.y_begin + rows * (i + 1) / bands, bands_[i]);
+        };
+        if (pool_ && bands > 1) {
+            pool_->parallelFor(bands, band);
+        } else {
+            for (int i = 0; i < bands; ++i) band(i);
+        }
+        histogram_.fill(0);
+        if (config_.edge_budget <= 0) return;
+        for (int i = 0; i < bands; ++i) {
+            for (int v = 0; v < 256; ++v) histogram_[v] += bands_[i].histogram[v];
         }
-
-        return kernel;
     }
 
-    void sobelFilter(const Frame& frame, Frame& mag, Frame& dir) {
-        int y0 = ImageMask::getMaskStartY(frame.height);
-        for (int y = y0; y < frame.height - 1; ++y) {
-            for (int x = 1; x < frame.width - 1; ++x) {
-                float gx = 0.0f;
-                float gy = 0.0f;
-
-                for (int ky = -1; ky <= 1; ++ky) {
-                    for (int kx = -1; kx <= 1; ++kx) {
-                        gx += frame.at(x + kx, y + ky) * sobel_x[ky + 1][kx + 1];
-                        gy += frame.at(x + kx, y + ky) * sobel_y[ky + 1][kx + 1];
-                    }
-                }
+    // NMS rows [y_begin, y_end), over the same spans as the whole-frame passes. Magnitude
+    // rows outside the gradient spans read as zero, like the never written rows there.
+    void runBand(const FrameView& frame, int y_begin, int y_end, CannyBandBuffers& buffers) {
+        const int w = frame.width;
+        const int h = frame.height;
+        const int kernel_size = gaussian_kernel_size_;
+        const int half_size = kernel_size / 2;
+        buffers.ensure(w, kernel_size);
+        buffers.histogram.fill(0);
 
-                float magnitude = std::sqrt(gx * gx + gy * gy);
-                magnitude = std::clamp(magnitude, 0.0f, 255.0f);
-                //compute approximation of
-                float angle = std::atan2(gy, gx);
+        auto slot = [w](std::vector<uint8_t>& rows, int y, int count) { return rows.data() + static_cast<size_t>(y % count) * w; };
+        const uint8_t* tmp_rows[15];
+        const uint8_t* blur_rows[3];
+        const uint8_t* mag_rows[3];
 
-                float angle_deg = angle * 180.0f / CV_PI;
-                if (angle_deg < 0) {
-                    angle_deg += 180.0f;
-                }
-                dir.at(x, y) = static_cast<uint8_t>((angle_deg / 180.0f) * 255.0f);
+        int next_tmp = std::max(0, y_begin - 2 - half_size);
+        auto blurRow = [&](int y) {
+            if (y < 0 || y >= h) return;
+            for (; next_tmp <= std::min(h - 1, y + half_size); ++next_tmp) {
+                horizontalBlurRow(frame.row(next_tmp), slot(buffers.tmp, next_tmp, kernel_size), w, tmp_spans_.row(next_tmp));
+            }
+            uint8_t* out = slot(buffers.blur, y, 3);
+            blur_rows[y % 3] = out;
+            const RowSpan& span = blur_spans_.row(y);
+            if (span.empty()) return;
+            for (int k = -half_size; k <= half_size; ++k) {
+                tmp_rows[k + half_size] = slot(buffers.tmp, std::clamp(y + k, 0, h - 1), kernel_size) + span.begin;
+            }
+            gaussian_rows_.vertical(tmp_rows, out + span.begin, span.end - span.begin, gaussian_weights_.data(), kernel_size);
+        };
+        auto gradientRow = [&](int y) {
+            if (y >= h || gradient_spans_.row(y).empty()) {
+                mag_rows[y % 3] = zero_row_.data();
+                return;
+            }
+            const RowSpan& span = gradient_spans_.row(y);
+            const int x = span.begin - 1;
+            uint8_t* out = slot(buffers.mag, y, 3);
+            sobel_row_(blur_rows[(y - 1) % 3] + x, blur_rows[y % 3] + x, blur_rows[(y + 1) % 3] + x, out + x,
+                       slot(buffers.dir, y, 3) + x, span.end - x + 1);
+            mag_rows[y % 3] = out;
+        };
 
+        // Prime the magnitude rows above and on the first NMS row. A blurred row is only
+        // produced once the gradient row three above it is done, its slot is reused.
+        blurRow(y_begin - 2);
+        blurRow(y_begin - 1);
+        blurRow(y_begin);
+        gradientRow(y_begin - 1);
+        blurRow(y_begin + 1);
+        gradientRow(y_begin);
+        for (int y = y_begin; y < y_end; ++y) {
+            blurRow(y + 2);
+            gradientRow(y + 1);
+            const RowSpan& span = nms_spans_.row(y);
+            if (span.empty()) continue;
+            const int x = span.begin - 1;
+            nonMaximumSuppressionRow(mag_rows[(y - 1) % 3] + x, mag_rows[y % 3] + x, mag_rows[(y + 1) % 3] + x,
+                                     slot(buffers.dir, y, 3) + x, nms.row(y) + x, span.end - x + 1);
+            if (config_.edge_budget > 0) {
+                accumulateHistogram(nms.row(y) + span.begin, span.end - span.begin, buffers.histogram);
+            }
+        }
+    }
 
-                mag.at(x, y) = static_cast<uint8_t>(magnitude);
+    // Hysteresis can only keep NMS survivors at or above the low threshold, so the
+    // histogram bounds the edge count for any threshold pair. The lowest high threshold
+    // whose bound, scaled by how much of it recent frames kept, fits the budget is the
+    // target. Rising thresholds apply at once, falling ones ease in over a few frames.
+    void chooseThresholds() {
+        if (config_.edge_budget <= 0) {
+            high_threshold_ = config_.high_threshold;
+            low_threshold_ = config_.low_threshold;
+            return;
+        }
+        const double ratio = config_.high_threshold > 0.0 ? config_.low_threshold / config_.high_threshold : 1.0;
+        const int min_high = std::clamp(static_cast<int>(std::ceil(config_.min_high_threshold)), 1, 255);
+        const int max_high = std::clamp(static_cast<int>(std::ceil(config_.max_high_threshold)), min_high, 255);
+        uint32_t above[257];
+        above[256] = 0;
+        for (int v = 255; v >= 0; --v) above[v] = above[v + 1] + histogram_[v];
+
+        int target = max_high;
+        for (int high = min_high; high <= max_high; ++high) {
+            const int low = std::clamp(static_cast<int>(std::ceil(ratio * high)), 1, high);
+            if (budget_correction_ * above[low] <= config_.edge_budget) {
+                target = high;
+                break;
             }
         }
+        if (high_threshold_ < 0.0 || target >= high_threshold_) {
+            high_threshold_ = target;
+        } else {
+            high_threshold_ += std::clamp(config_.threshold_smoothing, 0.0, 1.0) * (target - high_threshold_);
+        }
+        low_threshold_ = ratio * high_threshold_;
     }
 
-    void nonMaximumSuppression(const Frame& magnitude, const Frame& direction, Frame& nms) {
-        int y0 = magnitude.height / 2;
-        for (int y = y0; y < magnitude.height - 1; ++y) {
-            for (int x = 1; x < magnitude.width - 1; ++x) {
-                float angle = (direction.at(x, y)) / 255.0f * 180.0f;
-                float mag = magnitude.at(x, y);
-                float q = 255.0f;
-
-                uint8_t neighbor1 = 0, neighbor2 = 0;
-                int direction_index = static_cast<int>((angle + 22.5) / 45.0) % 4;
-
-                switch(direction_index) {
-                    case 0: // 0 degrees
-                        neighbor1 = magnitude.at(x + 1, y);
-                        neighbor2 = magnitude.at(x - 1, y);
-                        break;
-                    case 1: // 45 degrees
-                        neighbor1 = magnitude.at(x + 1, y - 1);
-                        neighbor2 = magnitude.at(x - 1, y + 1);
-                        break;
-                    case 2: // 90 degrees
-                        neighbor1 = magnitude.at(x, y - 1);
-                        neighbor2 = magnitude.at(x, y + 1);
-                        break;
-                    case 3: // 135 degrees
-                        neighbor1 = magnitude.at(x - 1, y - 1);
-                        neighbor2 = magnitude.at(x + 1, y + 1);
-                        break;
-                }
-                if (mag >= neighbor1 && mag >= neighbor2) {
-                    nms.at(x, y) = static_cast<uint8_t>(mag);
-                } else {
-                    nms.at(x, y) = 0;
+    void updateBudgetCorrection() {
+        if (config_.edge_budget <= 0) return;
+        uint32_t candidates = 0;
+        const int low = std::clamp(static_cast<int>(std::ceil(low_threshold_)), 1, 255);
+        for (int v = low; v < 256; ++v) candidates += histogram_[v];
+        if (candidates == 0) return;
+        const double kept = static_cast<double>(stats_.edge_pixels) / candidates;
+        budget_correction_ = std::clamp(0.75 * budget_correction_ + 0.25 * kept, 0.01, 1.0);
+    }
+
+    bool isVisited(size_t i) const {
+        return (visited_[i >> 6] >> (i & 63)) & 1;
+    }
+    void markVisited(size_t i) {
+        visited_[i >> 6] |= uint64_t(1) << (i & 63);
+    }
+
+    // Hysteresis thresholding: every pixel at or above the high threshold seeds a flood fill
+    // through 8-connected pixels at or above the low threshold, without leaving the ROI. Only
+    // pixels reached this way are kept (255), everything else is cleared. Kept pixels are
+    // also appended to edge_list when one is given.
+    void hysteresis(const Frame& nms, const FrameView* edge_map, Edges* edge_list) {
+        const int w = nms.width;
+        const int y_begin = nms_spans_.y_begin;
+        const int y_end = nms_spans_.y_end;
+        // nms is zero for suppressed pixels, so the weak bound has to stay above zero
+        const int high = std::max(1, static_cast<int>(std::ceil(high_threshold_)));
+        const int low = std::clamp(static_cast<int>(std::ceil(low_threshold_)), 1, high);
+
+        stats_ = CannyEdgeStats{};
+        stats_.high_threshold = high_threshold_;
+        stats_.low_threshold = low_threshold_;
+        if (edge_map) edge_map->fill(0);
+        if (y_begin >= y_end) return;
+
+        std::fill(visited_.begin() + (static_cast<size_t>(y_begin) * w) / 64, visited_.end(), 0);
+
+        static constexpr int kNeighborDx[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+        static constexpr int kNeighborDy[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+        for (int y = y_begin; y < y_end; ++y) {
+            const uint8_t* row = nms.row(y);
+            const RowSpan& span = nms_spans_.row(y);
+            for (int x = span.begin; x < span.end; ++x) {
+                if (row[x] < high) continue;
+                ++stats_.strong_pixels;
+                size_t seed = static_cast<size_t>(y) * w + x;
+                if (isVisited(seed)) continue;
+
+                markVisited(seed);
+                size_t top = 0;
+                stack_[top++] = static_cast<int32_t>(seed);
+                while (top > 0) {
+                    const int32_t i = stack_[--top];
+                    ++stats_.edge_pixels;
+
+                    const int px = i % w;
+                    const int py = i / w;
+                    if (edge_map) edge_map->at(px, py) = 255;
+                    if (edge_list) {
+                        edge_list->xs.push_back(static_cast<uint16_t>(px));
+                        edge_list->ys.push_back(static_cast<uint16_t>(py));
+                        if (config_.edge_directions) {
+                            edge_list->dirs.push_back(gradientAngle(blur, px, py));
+                        }
+                    }
+                    for (int k = 0; k < 8; ++k) {
+                        // Stay inside the region NMS wrote, everything else is stale
+                        const int nx = px + kNeighborDx[k];
+                        const int ny = py + kNeighborDy[k];
+                        if (!nms_spans_.contains(nx, ny)) continue;
+                        const int32_t n = ny * w + nx;
+                        if (nms.pixels[n] < low || isVisited(n)) continue;
+                        markVisited(n);
+                        stack_[top++] = n;
+                    }
                 }
-            // Hysterias Thresholding
-            if (mag >= config_.high_threshold) {
-                nms.at(x, y) = static_cast<uint8_t>(mag);
-            } else if (mag < config_.low_threshold) {
-                nms.at(x, y) = 0;
             }
         }
-        
-        }
     }
-};
 
-const Matrix canny_edge_detection_impl::sobel_x = {
-    { -1, 0, 1 },
-    { -2, 0, 2 },
-    { -1, 0, 1 }
-};
+    // Full-precision gradient angle for a single kept pixel, as documented on Edges::dirs.
+    // Only runs on the few percent of pixels that survive hysteresis.
+    static uint8_t gradientAngle(const Frame& blur, int x, int y) {
+        const uint8_t* above = blur.row(y - 1);
+        const uint8_t* row = blur.row(y);
+        const uint8_t* below = blur.row(y + 1);
+        int gx = (above[x + 1] - above[x - 1]) + 2 * (row[x + 1] - row[x - 1]) + (below[x + 1] - below[x - 1]);
+        // Sobel gy is y-up, flip it to image coordinates
+        int gy = (below[x - 1] + 2 * below[x] + below[x + 1]) - (above[x - 1] + 2 * above[x] + above[x + 1]);
+        float angle = std::atan2(static_cast<float>(gy), static_cast<float>(gx)) * 180.0f / static_cast<float>(CV_PI);
+        if (angle < 0.0f) angle += 180.0f;
+        int degrees = static_cast<int>(std::lround(angle));
+        return static_cast<uint8_t>(degrees >= 180 ? degrees - 180 : degrees);
+    }
 
-const Matrix canny_edge_detection_impl::sobel_y = {
-    {  1,  2,  1 },
-    {  0,  0,  0 },
-    { -1, -2, -1 }
+    const CannyEdgeStats& getStats() const override {
+        return stats_;
+    }
 };
 
-std::unique_ptr<CannyEdgeDetection> createCannyEdgeDetection() {
-    return std::make_unique<canny_edge_detection_impl>();
+std::unique_ptr<CannyEdgeDetection> createCannyEdgeDetection(const CannyEdgeConfig& config) {
+    return std::make_unique<canny_edge_detection_impl>(config);
 }
\ No newline at end of file
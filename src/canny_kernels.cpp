@@ -0,0 +1,602 @@
+#include "canny_kernels.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+
+#if defined(__x86_64__)
+#define CANNY_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+int gaussianKernelSize(double sigma) {
+    int kernel_size = static_cast<int>(std::ceil(3.0 * sigma));
+    if (kernel_size % 2 == 0) kernel_size++; // Ensure odd size
+    kernel_size= std::clamp(kernel_size, 1, 15);
+    return kernel_size;
+}
+
+std::vector<float> gaussianKernel1D(double sigma, int kernel_size) {
+    std::vector<float> kernel(kernel_size);
+    int half_size = kernel_size / 2;
+    float sum = 0.0f;
+
+    for (int i = -half_size; i <= half_size; ++i) {
+        float value = std::exp(-(i * i) / (2 * sigma * sigma));
+        kernel[i + half_size] = value;
+        sum += value;
+    }
+
+    // Normalize the kernel
+    for (auto& value : kernel) {
+        value /= sum;
+    }
+
+    return kernel;
+}
+
+std::vector<std::int16_t> quantizeGaussianKernel(const std::vector<float>& kernel) {
+    const int one = 1 << kGaussianFracBits;
+    std::vector<std::int16_t> weights(kernel.size());
+    // Rounded down, so a fixed-point sum never exceeds the float one
+    for (size_t i = 0; i < kernel.size(); ++i) {
+        weights[i] = static_cast<std::int16_t>(std::floor(kernel[i] * one));
+    }
+    return weights;
+}
+
+// Horizontal pass for a single pixel, dropping taps that fall outside the row
+static inline std::uint8_t gaussianHorizontalPixel(const std::uint8_t* src, int x, int width,
+                                                   const std::int16_t* weights, int half_size) {
+    int x_start = std::max(0, x - half_size);
+    int x_end = std::min(width - 1, x + half_size);
+    int sum = 0;
+    for (int xx = x_start; xx <= x_end; ++xx) {
+        sum += src[xx] * weights[xx - x + half_size];
+    }
+    return static_cast<std::uint8_t>(sum >> kGaussianFracBits);
+}
+
+// Left and right borders, where part of the kernel hangs off the row
+static void gaussianHorizontalBorders(const std::uint8_t* src, std::uint8_t* dst, int width,
+                                      const std::int16_t* weights, int kernel_size) {
+    const int half_size = kernel_size / 2;
+    const int left_end = std::min(half_size, width);
+    const int right_start = std::max(left_end, width - half_size);
+    for (int x = 0; x < left_end; ++x) {
+        dst[x] = gaussianHorizontalPixel(src, x, width, weights, half_size);
+    }
+    for (int x = right_start; x < width; ++x) {
+        dst[x] = gaussianHorizontalPixel(src, x, width, weights, half_size);
+    }
+}
+
+// Interior pixels in [x_begin, x_end), every tap is inside the row
+static inline void gaussianHorizontalInterior(const std::uint8_t* src, std::uint8_t* dst, int x_begin, int x_end,
+                                              const std::int16_t* weights, int kernel_size) {
+    const int half_size = kernel_size / 2;
+    for (int x = x_begin; x < x_end; ++x) {
+        const std::uint8_t* s = src + x - half_size;
+        int sum = 0;
+        for (int k = 0; k < kernel_size; ++k) {
+            sum += s[k] * weights[k];
+        }
+        dst[x] = static_cast<std::uint8_t>(sum >> kGaussianFracBits);
+    }
+}
+
+static inline void gaussianVerticalRange(const std::uint8_t* const* rows, std::uint8_t* dst, int x_begin, int x_end,
+                                         const std::int16_t* weights, int kernel_size) {
+    for (int x = x_begin; x < x_end; ++x) {
+        int sum = 0;
+        for (int k = 0; k < kernel_size; ++k) {
+            sum += rows[k][x] * weights[k];
+        }
+        dst[x] = static_cast<std::uint8_t>((sum + kGaussianRounding) >> kGaussianFracBits);
+    }
+}
+
+static void gaussianHorizontalRowScalar(const std::uint8_t* src, std::uint8_t* dst, int width,
+                                        const std::int16_t* weights, int kernel_size) {
+    const int half_size = kernel_size / 2;
+    gaussianHorizontalBorders(src, dst, width, weights, kernel_size);
+    gaussianHorizontalInterior(src, dst, half_size, width - half_size, weights, kernel_size);
+}
+
+static void gaussianVerticalRowScalar(const std::uint8_t* const* rows, std::uint8_t* dst, int width,
+                                      const std::int16_t* weights, int kernel_size) {
+    gaussianVerticalRange(rows, dst, 0, width, weights, kernel_size);
+}
+
+// Size-specialized blur. K is a compile-time constant so the tap loops unroll, and the
+// weights are symmetric, so mirrored pixels are added first and share one multiply.
+template <int K>
+static inline void gaussianHorizontalInteriorFixed(const std::uint8_t* src, std::uint8_t* dst, int x_begin, int x_end,
+                                                   const std::int16_t* weights) {
+    constexpr int half = K / 2;
+    for (int x = x_begin; x < x_end; ++x) {
+        const std::uint8_t* s = src + x - half;
+        int sum = s[half] * weights[half];
+        for (int k = 0; k < half; ++k) {
+            sum += (s[k] + s[K - 1 - k]) * weights[k];
+        }
+        dst[x] = static_cast<std::uint8_t>(sum >> kGaussianFracBits);
+    }
+}
+
+template <int K>
+static inline void gaussianVerticalRangeFixed(const std::uint8_t* const* rows, std::uint8_t* dst, int x_begin, int x_end,
+                                              const std::int16_t* weights) {
+    constexpr int half = K / 2;
+    for (int x = x_begin; x < x_end; ++x) {
+        int sum = rows[half][x] * weights[half];
+        for (int k = 0; k < half; ++k) {
+            sum += (rows[k][x] + rows[K - 1 - k][x]) * weights[k];
+        }
+        dst[x] = static_cast<std::uint8_t>((sum + kGaussianRounding) >> kGaussianFracBits);
+    }
+}
+
+template <int K>
+static void gaussianHorizontalRowScalarFixed(const std::uint8_t* src, std::uint8_t* dst, int width,
+                                             const std::int16_t* weights, int) {
+    gaussianHorizontalBorders(src, dst, width, weights, K);
+    gaussianHorizontalInteriorFixed<K>(src, dst, K / 2, width - K / 2, weights);
+}
+
+template <int K>
+static void gaussianVerticalRowScalarFixed(const std::uint8_t* const* rows, std::uint8_t* dst, int width,
+                                           const std::int16_t* weights, int) {
+    gaussianVerticalRangeFixed<K>(rows, dst, 0, width, weights);
+}
+
+// tan(22.5 deg) in Q16. tan(67.5 deg) = 2 + tan(22.5 deg), so one product serves both bounds.
+constexpr int kTan22_5Q16 = 27146;
+
+static inline void sobelRange(const std::uint8_t* above, const std::uint8_t* row, const std::uint8_t* below,
+                              std::uint8_t* mag, std::uint8_t* dir, int x_begin, int x_end) {
+    for (int x = x_begin; x < x_end; ++x) {
+        int gx = (above[x + 1] - above[x - 1]) + 2 * (row[x + 1] - row[x - 1]) + (below[x + 1] - below[x - 1]);
+        int gy = (above[x - 1] + 2 * above[x] + above[x + 1]) - (below[x - 1] + 2 * below[x] + below[x + 1]);
+        int ax = std::abs(gx);
+        int ay = std::abs(gy);
+        int t = (ax * kTan22_5Q16) >> 16;
+
+        std::uint8_t sector;
+        if (ay <= t) {
+            sector = kSector0;
+        } else if (ay > 2 * ax + t) {
+            sector = kSector90;
+        } else {
+            sector = (gx ^ gy) < 0 ? kSector135 : kSector45;
+        }
+        mag[x] = static_cast<std::uint8_t>(std::min(ax + ay, 255));
+        dir[x] = sector;
+    }
+}
+
+static void sobelRowScalar(const std::uint8_t* above, const std::uint8_t* row, const std::uint8_t* below,
+                           std::uint8_t* mag, std::uint8_t* dir, int width) {
+    sobelRange(above, row, below, mag, dir, 1, width - 1);
+}
+
+#ifdef CANNY_KERNELS_X86
+
+// 8 pixels: widen to u16, multiply by a 14-bit weight and accumulate the 32-bit products.
+// Weights are positive and below 2^15, so mullo/mulhi_epu16 give the exact product.
+static inline void accumulateWeighted8(__m128i pixels16, __m128i weight, __m128i& acc_lo, __m128i& acc_hi) {
+    __m128i lo = _mm_mullo_epi16(pixels16, weight);
+    __m128i hi = _mm_mulhi_epu16(pixels16, weight);
+    acc_lo = _mm_add_epi32(acc_lo, _mm_unpacklo_epi16(lo, hi));
+    acc_hi = _mm_add_epi32(acc_hi, _mm_unpackhi_epi16(lo, hi));
+}
+
+// rounding is added before the shift: 0 for the horizontal pass, kGaussianRounding for the vertical one
+static inline void storeNarrowed8(std::uint8_t* dst, __m128i acc_lo, __m128i acc_hi, int rounding) {
+    const __m128i offset = _mm_set1_epi32(rounding);
+    __m128i words = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(acc_lo, offset), kGaussianFracBits),
+                                    _mm_srai_epi32(_mm_add_epi32(acc_hi, offset), kGaussianFracBits));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(words, words));
+}
+
+static void gaussianHorizontalRowSse2(const std::uint8_t* src, std::uint8_t* dst, int width,
+                                      const std::int16_t* weights, int kernel_size) {
+    const int half_size = kernel_size / 2;
+    gaussianHorizontalBorders(src, dst, width, weights, kernel_size);
+
+    const __m128i zero = _mm_setzero_si128();
+    int x = half_size;
+    for (; x + 8 + half_size <= width; x += 8) {
+        __m128i acc_lo = zero, acc_hi = zero;
+        const std::uint8_t* s = src + x - half_size;
+        for (int k = 0; k < kernel_size; ++k) {
+            __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + k)), zero);
+            accumulateWeighted8(p, _mm_set1_epi16(weights[k]), acc_lo, acc_hi);
+        }
+        storeNarrowed8(dst + x, acc_lo, acc_hi, 0);
+    }
+    gaussianHorizontalInterior(src, dst, x, width - half_size, weights, kernel_size);
+}
+
+static void gaussianVerticalRowSse2(const std::uint8_t* const* rows, std::uint8_t* dst, int width,
+                                    const std::int16_t* weights, int kernel_size) {
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i acc_lo = zero, acc_hi = zero;
+        for (int k = 0; k < kernel_size; ++k) {
+            __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows[k] + x)), zero);
+            accumulateWeighted8(p, _mm_set1_epi16(weights[k]), acc_lo, acc_hi);
+        }
+        storeNarrowed8(dst + x, acc_lo, acc_hi, kGaussianRounding);
+    }
+    gaussianVerticalRange(rows, dst, x, width, weights, kernel_size);
+}
+
+// Sobel on 8 pixels held as 16-bit lanes. a/r/b are the rows above, at and below x,
+// the 0/1/2 suffix the x-1, x and x+1 columns.
+static inline void sobelLanes8(__m128i a0, __m128i a1, __m128i a2, __m128i r0, __m128i r2,
+                               __m128i b0, __m128i b1, __m128i b2, __m128i& mag, __m128i& sector) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i gx = _mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(a2, a0), _mm_sub_epi16(b2, b0)),
+                               _mm_slli_epi16(_mm_sub_epi16(r2, r0), 1));
+    __m128i gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(a0, a2), _mm_slli_epi16(a1, 1)),
+                               _mm_add_epi16(_mm_add_epi16(b0, b2), _mm_slli_epi16(b1, 1)));
+    __m128i ax = _mm_max_epi16(gx, _mm_sub_epi16(zero, gx));
+    __m128i ay = _mm_max_epi16(gy, _mm_sub_epi16(zero, gy));
+    __m128i t = _mm_mulhi_epu16(ax, _mm_set1_epi16(static_cast<short>(kTan22_5Q16)));
+
+    __m128i not_flat = _mm_cmpgt_epi16(ay, t);
+    __m128i steep = _mm_cmpgt_epi16(ay, _mm_add_epi16(_mm_add_epi16(ax, ax), t));
+    __m128i opposite = _mm_srai_epi16(_mm_xor_si128(gx, gy), 15);
+    __m128i diagonal = _mm_or_si128(_mm_set1_epi16(kSector45), _mm_and_si128(opposite, _mm_set1_epi16(2)));
+    __m128i s = _mm_or_si128(_mm_and_si128(steep, _mm_set1_epi16(kSector90)), _mm_andnot_si128(steep, diagonal));
+
+    mag = _mm_add_epi16(ax, ay);
+    sector = _mm_and_si128(not_flat, s);
+}
+
+static void sobelRowSse2(const std::uint8_t* above, const std::uint8_t* row, const std::uint8_t* below,
+                         std::uint8_t* mag, std::uint8_t* dir, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    auto load8 = [&](const std::uint8_t* p) {
+        return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero);
+    };
+    int x = 1;
+    for (; x + 9 <= width; x += 8) {
+        __m128i m, s;
+        sobelLanes8(load8(above + x - 1), load8(above + x), load8(above + x + 1),
+                    load8(row + x - 1), load8(row + x + 1),
+                    load8(below + x - 1), load8(below + x), load8(below + x + 1), m, s);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(mag + x), _mm_packus_epi16(m, m));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dir + x), _mm_packus_epi16(s, s));
+    }
+    sobelRange(above, row, below, mag, dir, x, width - 1);
+}
+
+// The AVX2 versions do 16 pixels per step. unpacklo/hi and packs work per 128-bit lane,
+// so the words come back in order and only the final byte pack needs the two halves.
+__attribute__((target("avx2")))
+static inline void accumulateWeighted16(__m256i pixels16, __m256i weight, __m256i& acc_lo, __m256i& acc_hi) {
+    __m256i lo = _mm256_mullo_epi16(pixels16, weight);
+    __m256i hi = _mm256_mulhi_epu16(pixels16, weight);
+    acc_lo = _mm256_add_epi32(acc_lo, _mm256_unpacklo_epi16(lo, hi));
+    acc_hi = _mm256_add_epi32(acc_hi, _mm256_unpackhi_epi16(lo, hi));
+}
+
+__attribute__((target("avx2")))
+static inline void storeBytes16(std::uint8_t* dst, __m256i words) {
+    __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), bytes);
+}
+
+__attribute__((target("avx2")))
+static inline void storeNarrowed16(std::uint8_t* dst, __m256i acc_lo, __m256i acc_hi, int rounding) {
+    const __m256i offset = _mm256_set1_epi32(rounding);
+    storeBytes16(dst, _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(acc_lo, offset), kGaussianFracBits),
+                                         _mm256_srai_epi32(_mm256_add_epi32(acc_hi, offset), kGaussianFracBits)));
+}
+
+__attribute__((target("avx2")))
+static void gaussianHorizontalRowAvx2(const std::uint8_t* src, std::uint8_t* dst, int width,
+                                      const std::int16_t* weights, int kernel_size) {
+    const int half_size = kernel_size / 2;
+    gaussianHorizontalBorders(src, dst, width, weights, kernel_size);
+
+    int x = half_size;
+    for (; x + 16 + half_size <= width; x += 16) {
+        __m256i acc_lo = _mm256_setzero_si256(), acc_hi = _mm256_setzero_si256();
+        const std::uint8_t* s = src + x - half_size;
+        for (int k = 0; k < kernel_size; ++k) {
+            __m256i p = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + k)));
+            accumulateWeighted16(p, _mm256_set1_epi16(weights[k]), acc_lo, acc_hi);
+        }
+        storeNarrowed16(dst + x, acc_lo, acc_hi, 0);
+    }
+    gaussianHorizontalInterior(src, dst, x, width - half_size, weights, kernel_size);
+}
+
+__attribute__((target("avx2")))
+static void gaussianVerticalRowAvx2(const std::uint8_t* const* rows, std::uint8_t* dst, int width,
+                                    const std::int16_t* weights, int kernel_size) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i acc_lo = _mm256_setzero_si256(), acc_hi = _mm256_setzero_si256();
+        for (int k = 0; k < kernel_size; ++k) {
+            __m256i p = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + x)));
+            accumulateWeighted16(p, _mm256_set1_epi16(weights[k]), acc_lo, acc_hi);
+        }
+        storeNarrowed16(dst + x, acc_lo, acc_hi, kGaussianRounding);
+    }
+    gaussianVerticalRange(rows, dst, x, width, weights, kernel_size);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i load16(const std::uint8_t* p) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+__attribute__((target("avx2")))
+static void sobelRowAvx2(const std::uint8_t* above, const std::uint8_t* row, const std::uint8_t* below,
+                         std::uint8_t* mag, std::uint8_t* dir, int width) {
+    int x = 1;
+    for (; x + 17 <= width; x += 16) {
+        __m256i a0 = load16(above + x - 1), a1 = load16(above + x), a2 = load16(above + x + 1);
+        __m256i r0 = load16(row + x - 1), r2 = load16(row + x + 1);
+        __m256i b0 = load16(below + x - 1), b1 = load16(below + x), b2 = load16(below + x + 1);
+
+        __m256i gx = _mm256_add_epi16(_mm256_add_epi16(_mm256_sub_epi16(a2, a0), _mm256_sub_epi16(b2, b0)),
+                                      _mm256_slli_epi16(_mm256_sub_epi16(r2, r0), 1));
+        __m256i gy = _mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(a0, a2), _mm256_slli_epi16(a1, 1)),
+                                      _mm256_add_epi16(_mm256_add_epi16(b0, b2), _mm256_slli_epi16(b1, 1)));
+        __m256i ax = _mm256_abs_epi16(gx);
+        __m256i ay = _mm256_abs_epi16(gy);
+        __m256i t = _mm256_mulhi_epu16(ax, _mm256_set1_epi16(static_cast<short>(kTan22_5Q16)));
+
+        __m256i not_flat = _mm256_cmpgt_epi16(ay, t);
+        __m256i steep = _mm256_cmpgt_epi16(ay, _mm256_add_epi16(_mm256_add_epi16(ax, ax), t));
+        __m256i opposite = _mm256_srai_epi16(_mm256_xor_si256(gx, gy), 15);
+        __m256i diagonal = _mm256_or_si256(_mm256_set1_epi16(kSector45),
+                                           _mm256_and_si256(opposite, _mm256_set1_epi16(2)));
+        __m256i s = _mm256_blendv_epi8(diagonal, _mm256_set1_epi16(kSector90), steep);
+
+        storeBytes16(mag + x, _mm256_add_epi16(ax, ay));
+        storeBytes16(dir + x, _mm256_and_si256(not_flat, s));
+    }
+    sobelRange(above, row, below, mag, dir, x, width - 1);
+}
+
+// Size-specialized SIMD blur. Mirrored pixels are summed into 16-bit lanes (at most 510),
+// then pmaddwd multiplies two of those sums by their weights and adds the products in one
+// step. The interleave puts pixels in the same lane order as accumulateWeighted8/16.
+// Both weights of a pair go in one 32-bit lane, the first in the low half.
+static inline std::int32_t weightPair(const std::int16_t* weights, int first, int second, int count) {
+    const std::uint16_t low = static_cast<std::uint16_t>(weights[first]);
+    const std::uint16_t high = second < count ? static_cast<std::uint16_t>(weights[second]) : 0;
+    return static_cast<std::int32_t>(low | (static_cast<std::uint32_t>(high) << 16));
+}
+
+static inline __m128i widen8(const std::uint8_t* p) {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+}
+
+static inline void accumulatePair8(__m128i a, __m128i b, __m128i weights, __m128i& acc_lo, __m128i& acc_hi) {
+    acc_lo = _mm_add_epi32(acc_lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights));
+    acc_hi = _mm_add_epi32(acc_hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights));
+}
+
+// Folded taps of 8 pixels: values[k] for k < half is the sum of taps k and K - 1 - k,
+// values[half] is the centre tap
+template <int K, typename Load>
+static inline void blurFolded8(Load&& load, const __m128i* pairs, std::uint8_t* dst, int rounding) {
+    constexpr int half = K / 2;
+    __m128i values[half + 2];
+    for (int k = 0; k < half; ++k) {
+        values[k] = _mm_add_epi16(load(k), load(K - 1 - k));
+    }
+    values[half] = load(half);
+    values[half + 1] = _mm_setzero_si128();
+    __m128i acc_lo = _mm_setzero_si128(), acc_hi = _mm_setzero_si128();
+    for (int k = 0; k <= half; k += 2) {
+        accumulatePair8(values[k], values[k + 1], pairs[k / 2], acc_lo, acc_hi);
+    }
+    storeNarrowed8(dst, acc_lo, acc_hi, rounding);
+}
+
+template <int K>
+static void gaussianHorizontalRowSse2Fixed(const std::uint8_t* src, std::uint8_t* dst, int width,
+                                           const std::int16_t* weights, int) {
+    constexpr int half = K / 2;
+    gaussianHorizontalBorders(src, dst, width, weights, K);
+    __m128i pairs[half / 2 + 1];
+    for (int k = 0; k <= half; k += 2) pairs[k / 2] = _mm_set1_epi32(weightPair(weights, k, k + 1, half + 1));
+
+    int x = half;
+    for (; x + 8 + half <= width; x += 8) {
+        const std::uint8_t* s = src + x - half;
+        blurFolded8<K>([s](int k) { return widen8(s + k); }, pairs, dst + x, 0);
+    }
+    gaussianHorizontalInteriorFixed<K>(src, dst, x, width - half, weights);
+}
+
+template <int K>
+static void gaussianVerticalRowSse2Fixed(const std::uint8_t* const* rows, std::uint8_t* dst, int width,
+                                         const std::int16_t* weights, int) {
+    constexpr int half = K / 2;
+    __m128i pairs[half / 2 + 1];
+    for (int k = 0; k <= half; k += 2) pairs[k / 2] = _mm_set1_epi32(weightPair(weights, k, k + 1, half + 1));
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        blurFolded8<K>([rows, x](int k) { return widen8(rows[k] + x); }, pairs, dst + x, kGaussianRounding);
+    }
+    gaussianVerticalRangeFixed<K>(rows, dst, x, width, weights);
+}
+
+__attribute__((target("avx2")))
+static inline void accumulatePair16(__m256i a, __m256i b, __m256i weights, __m256i& acc_lo, __m256i& acc_hi) {
+    acc_lo = _mm256_add_epi32(acc_lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), weights));
+    acc_hi = _mm256_add_epi32(acc_hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), weights));
+}
+
+template <int K, typename Load>
+__attribute__((target("avx2")))
+static inline void blurFolded16(Load&& load, const __m256i* pairs, std::uint8_t* dst, int rounding) {
+    constexpr int half = K / 2;
+    __m256i values[half + 2];
+    for (int k = 0; k < half; ++k) {
+        values[k] = _mm256_add_epi16(load(k), load(K - 1 - k));
+    }
+    values[half] = load(half);
+    values[half + 1] = _mm256_setzero_si256();
+    __m256i acc_lo = _mm256_setzero_si256(), acc_hi = _mm256_setzero_si256();
+    for (int k = 0; k <= half; k += 2) {
+        accumulatePair16(values[k], values[k + 1], pairs[k / 2], acc_lo, acc_hi);
+    }
+    storeNarrowed16(dst, acc_lo, acc_hi, rounding);
+}
+
+template <int K>
+__attribute__((target("avx2")))
+static void gaussianHorizontalRowAvx2Fixed(const std::uint8_t* src, std::uint8_t* dst, int width,
+                                           const std::int16_t* weights, int) {
+    constexpr int half = K / 2;
+    gaussianHorizontalBorders(src, dst, width, weights, K);
+    __m256i pairs[half / 2 + 1];
+    for (int k = 0; k <= half; k += 2) pairs[k / 2] = _mm256_set1_epi32(weightPair(weights, k, k + 1, half + 1));
+
+    int x = half;
+    for (; x + 16 + half <= width; x += 16) {
+        const std::uint8_t* s = src + x - half;
+        blurFolded16<K>([s](int k) __attribute__((target("avx2"))) { return load16(s + k); }, pairs, dst + x, 0);
+    }
+    gaussianHorizontalInteriorFixed<K>(src, dst, x, width - half, weights);
+}
+
+template <int K>
+__attribute__((target("avx2")))
+static void gaussianVerticalRowAvx2Fixed(const std::uint8_t* const* rows, std::uint8_t* dst, int width,
+                                         const std::int16_t* weights, int) {
+    constexpr int half = K / 2;
+    __m256i pairs[half / 2 + 1];
+    for (int k = 0; k <= half; k += 2) pairs[k / 2] = _mm256_set1_epi32(weightPair(weights, k, k + 1, half + 1));
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        blurFolded16<K>([rows, x](int k) __attribute__((target("avx2"))) { return load16(rows[k] + x); }, pairs, dst + x, kGaussianRounding);
+    }
+    gaussianVerticalRangeFixed<K>(rows, dst, x, width, weights);
+}
+
+#endif
+
+GaussianRowKernels scalarGaussianRowKernels() {
+    return {gaussianHorizontalRowScalar, gaussianVerticalRowScalar, "scalar"};
+}
+
+GaussianRowKernels selectGaussianRowKernels() {
+#ifdef CANNY_KERNELS_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return {gaussianHorizontalRowAvx2, gaussianVerticalRowAvx2, "avx2"};
+    }
+    return {gaussianHorizontalRowSse2, gaussianVerticalRowSse2, "sse2"};
+#else
+    return scalarGaussianRowKernels();
+#endif
+}
+
+// One entry per odd kernel size, indexed by kernel_size / 2
+template <template <int> class Kernels, int... Halves>
+static constexpr std::array<GaussianRowKernels, sizeof...(Halves)> fixedKernelTable(std::integer_sequence<int, Halves...>) {
+    return {Kernels<2 * Halves + 1>::get()...};
+}
+
+template <int K>
+struct ScalarFixed {
+    static constexpr GaussianRowKernels get() {
+        return {gaussianHorizontalRowScalarFixed<K>, gaussianVerticalRowScalarFixed<K>, "scalar fixed"};
+    }
+};
+
+#ifdef CANNY_KERNELS_X86
+template <int K>
+struct Sse2Fixed {
+    static constexpr GaussianRowKernels get() {
+        return {gaussianHorizontalRowSse2Fixed<K>, gaussianVerticalRowSse2Fixed<K>, "sse2 fixed"};
+    }
+};
+
+template <int K>
+struct Avx2Fixed {
+    static constexpr GaussianRowKernels get() {
+        return {gaussianHorizontalRowAvx2Fixed<K>, gaussianVerticalRowAvx2Fixed<K>, "avx2 fixed"};
+    }
+};
+#endif
+
+constexpr int kFixedKernelSizes = 8; // 1, 3, ..., 15
+
+GaussianRowKernels selectGaussianRowKernels(int kernel_size) {
+    if (kernel_size < 1 || kernel_size > 2 * kFixedKernelSizes - 1 || kernel_size % 2 == 0) {
+        return selectGaussianRowKernels();
+    }
+    constexpr auto halves = std::make_integer_sequence<int, kFixedKernelSizes>();
+#ifdef CANNY_KERNELS_X86
+    static const auto avx2 = fixedKernelTable<Avx2Fixed>(halves);
+    static const auto sse2 = fixedKernelTable<Sse2Fixed>(halves);
+    return __builtin_cpu_supports("avx2") ? avx2[kernel_size / 2] : sse2[kernel_size / 2];
+#else
+    static const auto scalar = fixedKernelTable<ScalarFixed>(halves);
+    return scalar[kernel_size / 2];
+#endif
+}
+
+GaussianRowKernels scalarGaussianRowKernels(int kernel_size) {
+    if (kernel_size < 1 || kernel_size > 2 * kFixedKernelSizes - 1 || kernel_size % 2 == 0) {
+        return scalarGaussianRowKernels();
+    }
+    static const auto scalar = fixedKernelTable<ScalarFixed>(std::make_integer_sequence<int, kFixedKernelSizes>());
+    return scalar[kernel_size / 2];
+}
+
+SobelRowFn scalarSobelRowKernel() {
+    return sobelRowScalar;
+}
+
+SobelRowFn selectSobelRowKernel() {
+#ifdef CANNY_KERNELS_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return sobelRowAvx2;
+    }
+    return sobelRowSse2;
+#else
+    return scalarSobelRowKernel();
+#endif
+}
+
+void nonMaximumSuppressionRow(const std::uint8_t* mag_above, const std::uint8_t* mag_row, const std::uint8_t* mag_below,
+                              const std::uint8_t* dir, std::uint8_t* out, int width) {
+    for (int x = 1; x < width - 1; ++x) {
+        const std::uint8_t mag = mag_row[x];
+        std::uint8_t neighbor1 = 0, neighbor2 = 0;
+        switch (dir[x]) {
+            case kSector0: // 0 degrees
+                neighbor1 = mag_row[x + 1];
+                neighbor2 = mag_row[x - 1];
+                break;
+            case kSector45: // 45 degrees
+                neighbor1 = mag_above[x + 1];
+                neighbor2 = mag_below[x - 1];
+                break;
+            case kSector90: // 90 degrees
+                neighbor1 = mag_above[x];
+                neighbor2 = mag_below[x];
+                break;
+            case kSector135: // 135 degrees
+                neighbor1 = mag_above[x - 1];
+                neighbor2 = mag_below[x + 1];
+                break;
+        }
+        out[x] = mag >= neighbor1 && mag >= neighbor2 ? mag : 0;
+    }
+}
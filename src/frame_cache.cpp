@@ -0,0 +1,173 @@
+#include "frame_cache.h"
+#include "instrumentation.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint64_t kPageSize = 4096;
+
+uint64_t roundUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+bool isFrameCachePath(const std::string& path) {
+    const size_t length = std::strlen(kFrameCacheExtension);
+    if (path.size() <= length) return false;
+    // Case-insensitive, like the video extensions batch mode looks for
+    return std::equal(path.end() - length, path.end(), kFrameCacheExtension,
+                      [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+}
+
+bool FrameCacheWriter::open(const std::string& path, int width, int height, int y_begin, int y_end) {
+    if (width <= 0 || height <= 0) return false;
+    if (y_end <= 0) y_end = height;
+    y_begin = std::clamp(y_begin, 0, height);
+    y_end = std::clamp(y_end, y_begin, height);
+    if (y_begin >= y_end) return false;
+
+    header_ = FrameCacheHeader{};
+    header_.width = static_cast<uint32_t>(width);
+    header_.height = static_cast<uint32_t>(height);
+    header_.y_begin = static_cast<uint32_t>(y_begin);
+    header_.rows = static_cast<uint32_t>(y_end - y_begin);
+    header_.stride = static_cast<uint32_t>(roundUp(width, 64));
+    header_.frame_size = static_cast<uint64_t>(header_.stride) * header_.rows;
+    header_.data_offset = roundUp(std::max<uint64_t>(sizeof(FrameCacheHeader), uint64_t(y_begin) * header_.stride), kPageSize);
+    row_.assign(header_.stride, 0);
+
+    out_.open(path, std::ios::binary | std::ios::trunc);
+    if (!out_) return false;
+    // The frame count stays 0 until close(), a cut-short file reads as empty
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    const std::vector<char> padding(header_.data_offset - sizeof(header_), 0);
+    out_.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    return static_cast<bool>(out_);
+}
+
+bool FrameCacheWriter::write(const FrameView& frame) {
+    if (!out_.is_open() || frame.width != static_cast<int>(header_.width) ||
+        frame.height != static_cast<int>(header_.height)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < header_.rows; ++i) {
+        std::memcpy(row_.data(), frame.row(static_cast<int>(header_.y_begin + i)), header_.width);
+        out_.write(reinterpret_cast<const char*>(row_.data()), header_.stride);
+    }
+    ++header_.frame_count;
+    return static_cast<bool>(out_);
+}
+
+bool FrameCacheWriter::close() {
+    if (!out_.is_open()) return false;
+    // Rows below the cached ones of the last frame have to be inside the file too
+    const std::vector<char> padding(static_cast<size_t>(header_.height - header_.y_begin - header_.rows) * header_.stride, 0);
+    out_.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    out_.close();
+    return !out_.fail();
+}
+
+struct FrameCacheVideoServiceImpl : public VideoService {
+
+    FrameCacheConfig config_;
+    FrameCacheHeader header_;
+    uint8_t* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+    uint64_t next_frame_ = 0;
+    int pass_ = 0;
+
+    explicit FrameCacheVideoServiceImpl(const FrameCacheConfig& config) : config_(config) {}
+
+    ~FrameCacheVideoServiceImpl() override {
+        unmap();
+    }
+
+    void unmap() {
+        if (mapping_) munmap(mapping_, mapping_size_);
+        mapping_ = nullptr;
+        mapping_size_ = 0;
+    }
+
+    bool initialize(const std::string& video_path) override {
+        unmap();
+        next_frame_ = 0;
+        pass_ = 0;
+        const int fd = ::open(video_path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        void* mapping = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(FrameCacheHeader)) {
+            mapping_size_ = static_cast<size_t>(info.st_size);
+            mapping = mmap(nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        // The mapping keeps the file open
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            mapping_size_ = 0;
+            return false;
+        }
+        mapping_ = static_cast<uint8_t*>(mapping);
+        std::memcpy(&header_, mapping_, sizeof(header_));
+        if (!valid()) {
+            unmap();
+            return false;
+        }
+        madvise(mapping_, mapping_size_, config_.preload ? MADV_WILLNEED : MADV_SEQUENTIAL);
+        return true;
+    }
+
+    // Checks the header against the file size, so no view can reach past the mapping.
+    // Every sum is bounded before it is formed, a crafted header can't wrap one around.
+    bool valid() const {
+        const FrameCacheHeader expected;
+        if (std::memcmp(header_.magic, expected.magic, sizeof(expected.magic)) != 0) return false;
+        if (header_.version != expected.version) return false;
+        // Views take int sizes and index rows with int * stride
+        if (header_.width == 0 || header_.width > INT_MAX || header_.height == 0 || header_.height > INT_MAX) return false;
+        if (header_.stride != roundUp(header_.width, 64) || uint64_t(header_.stride) * header_.height > INT_MAX) return false;
+        if (header_.rows == 0 || header_.y_begin + uint64_t(header_.rows) > header_.height) return false;
+        if (header_.frame_size != uint64_t(header_.stride) * header_.rows) return false;
+        if (header_.data_offset < uint64_t(header_.y_begin) * header_.stride) return false;
+        const uint64_t below = uint64_t(header_.height - header_.y_begin - header_.rows) * header_.stride;
+        if (header_.data_offset > mapping_size_ || below > mapping_size_ - header_.data_offset) return false;
+        return header_.frame_count <= (mapping_size_ - header_.data_offset - below) / header_.frame_size;
+    }
+
+    bool getFrame(FrameView& frame, cv::Mat* color) override {
+        if (!hasMoreFrames()) return false;
+        if (next_frame_ == header_.frame_count) {
+            next_frame_ = 0;
+            ++pass_;
+        }
+        CLT_SCOPED_TIMER(Decode);
+        // Row y_begin of the view is the first cached row
+        uint8_t* first_row = mapping_ + header_.data_offset + next_frame_ * header_.frame_size;
+        frame = FrameView(first_row - static_cast<size_t>(header_.y_begin) * header_.stride, static_cast<int>(header_.width),
+                          static_cast<int>(header_.height), header_.stride);
+        ++next_frame_;
+        if (color) color->release();
+        return true;
+    }
+
+    // Views point into the mapping, there is nothing to hand back
+    void releaseFrame(const FrameView&) override {}
+
+    bool hasMoreFrames() override {
+        if (!mapping_ || header_.frame_count == 0) return false;
+        return next_frame_ < header_.frame_count || pass_ + 1 < config_.repeat;
+    }
+};
+
+std::unique_ptr<VideoService> createFrameCacheVideoService(const FrameCacheConfig& config) {
+    return std::make_unique<FrameCacheVideoServiceImpl>(config);
+}
@@ -0,0 +1,37 @@
+#include "frame_pool.h"
+
+FrameView FramePool::acquire(int width, int height) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int index;
+    if (free_.empty()) {
+        index = static_cast<int>(buffers_.size());
+        buffers_.push_back(std::make_unique<Frame>(width, height));
+        in_use_.push_back(false);
+        // Every buffer can be free at once, so release() never has to grow this
+        free_.reserve(buffers_.capacity());
+    } else {
+        index = free_.back();
+        free_.pop_back();
+    }
+    in_use_[index] = true;
+    Frame& buffer = *buffers_[index];
+    if (buffer.width != width || buffer.height != height) {
+        buffer = Frame(width, height);
+    }
+    FrameView view(buffer);
+    view.pool_index = index;
+    return view;
+}
+
+void FramePool::release(const FrameView& view) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (view.pool_index < 0 || view.pool_index >= static_cast<int>(buffers_.size())) return;
+    if (buffers_[view.pool_index]->pixels.data() != view.data || !in_use_[view.pool_index]) return;
+    in_use_[view.pool_index] = false;
+    free_.push_back(view.pool_index);
+}
+
+size_t FramePool::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buffers_.size();
+}
@@ -0,0 +1,188 @@
+#include "hough_accumulator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+double HoughAccumulator::maxRhoStep(int width, int height) {
+    // Along the longer side every row or column adds at most ceil(rhoStep * sqrt 2) + 1 pixels.
+    // Solving with one spare pixel for the ceil and the fixed-point rounding gives the step.
+    const double side = std::max(1, std::max(width, height));
+    return std::max(0.0, (kMaxCount / side - 2.0) / std::sqrt(2.0));
+}
+
+bool HoughAccumulator::configure(const HoughTransformConfig& config, int width, int height, int first_row) {
+    if (width == cached_width_ && height == cached_height_ && first_row == y_begin &&
+        config.minTheta == cached_config_.minTheta && config.maxTheta == cached_config_.maxTheta &&
+        config.angleStep == cached_config_.angleStep && config.rhoStep == cached_config_.rhoStep) {
+        return false;
+    }
+    cached_width_ = width;
+    cached_height_ = height;
+    cached_config_ = config;
+    y_begin = std::max(0, first_row);
+    const double max_step = maxRhoStep(width, height);
+    rho_step = max_step > 0.0 ? std::min(config.rhoStep, max_step) : config.rhoStep;
+
+    thetas_rad.clear();
+    for (double theta = config.minTheta; theta <= config.maxTheta; theta += config.angleStep) {
+        thetas_rad.push_back(theta * CV_PI / 180.0);
+    }
+    theta_bins = thetas_rad.size();
+
+    const double diagLen = std::sqrt(static_cast<double>(width) * width + static_cast<double>(height) * height);
+    rho_min = -diagLen;
+    rho_bins = 0;
+    for (double r = -diagLen; r <= diagLen; r += rho_step) {
+        ++rho_bins;
+    }
+
+    // Largest fraction that keeps x*cos + y*sin + offset, at most about 2 * diag / rhoStep bins, inside int32
+    const double max_index = 2.0 * diagLen / rho_step + 2.0;
+    frac_bits = 16;
+    while (frac_bits > 0 && max_index * std::ldexp(1.0, frac_bits) >= std::numeric_limits<std::int32_t>::max()) {
+        --frac_bits;
+    }
+    const double scale = std::ldexp(1.0, frac_bits);
+    cos_q.resize(theta_bins);
+    sin_q.resize(theta_bins);
+    for (size_t t = 0; t < theta_bins; ++t) {
+        cos_q[t] = static_cast<std::int32_t>(std::lround(std::cos(thetas_rad[t]) / rho_step * scale));
+        sin_q[t] = static_cast<std::int32_t>(std::lround(std::sin(thetas_rad[t]) / rho_step * scale));
+    }
+    // Adding half a bin turns the final shift into round-to-nearest
+    rho_offset_q = static_cast<std::int32_t>(std::lround((-rho_min / rho_step + 0.5) * scale));
+
+    // rho is linear in x and y, so its extremes over the voting rows sit on the corners
+    reach_begin.resize(theta_bins);
+    reach_end.resize(theta_bins);
+    const int corners_x[2] = {0, std::max(0, width - 1)};
+    const int corners_y[2] = {y_begin, std::max(y_begin, height - 1)};
+    for (size_t t = 0; t < theta_bins; ++t) {
+        std::int32_t lo = std::numeric_limits<std::int32_t>::max();
+        std::int32_t hi = std::numeric_limits<std::int32_t>::min();
+        for (int cx : corners_x) {
+            for (int cy : corners_y) {
+                std::int32_t r = rhoIndex(t, cx, cy);
+                lo = std::min(lo, r);
+                hi = std::max(hi, r);
+            }
+        }
+        reach_begin[t] = std::clamp<std::int32_t>(lo, 0, static_cast<std::int32_t>(rho_bins));
+        reach_end[t] = std::clamp<std::int32_t>(hi + 1, reach_begin[t], static_cast<std::int32_t>(rho_bins));
+    }
+
+    votes.assign(theta_bins * rho_bins, 0);
+    return true;
+}
+
+void HoughAccumulator::clear() {
+    for (size_t t = 0; t < theta_bins; ++t) {
+        Count* col = column(t);
+        std::memset(col + reach_begin[t], 0, sizeof(Count) * (reach_end[t] - reach_begin[t]));
+    }
+}
+
+bool HoughPeakFinder::isStrictMaximum(const HoughAccumulator& acc, size_t r, size_t t, int radius) const {
+    const HoughAccumulator::Count current = acc.at(r, t);
+    for (int dt = -radius; dt <= radius; ++dt) {
+        for (int dr = -radius; dr <= radius; ++dr) {
+            if (dr == 0 && dt == 0) continue;
+            size_t nr = r + dr;
+            size_t nt = t + dt;
+            if (nr >= acc.rho_bins || nt >= acc.theta_bins) continue;
+            if (acc.at(nr, nt) >= current) return false;
+        }
+    }
+    return true;
+}
+
+void HoughPeakFinder::find(const HoughAccumulator& acc, int threshold, int radius, size_t max_peaks,
+                           std::vector<HoughLine>& peaks) {
+    using Count = HoughAccumulator::Count;
+    peaks.clear();
+    candidates = 0;
+    const size_t T = acc.theta_bins;
+    const int R = static_cast<int>(acc.rho_bins);
+    if (T == 0 || R == 0 || max_peaks == 0) return;
+    radius = std::max(0, radius);
+    const Count min_votes = static_cast<Count>(std::clamp(threshold, 1, 0xFFFF));
+
+    rho_max_.resize(acc.votes.size());
+    window_max_.resize(acc.rho_bins);
+    hot_begin_.resize(T);
+    hot_end_.resize(T);
+    filter_begin_.resize(T);
+    filter_end_.resize(T);
+
+    // Only cells at or above the threshold can be peaks. Record the rho range holding them in
+    // each column, then filter just the bins those ranges can see through the window.
+    for (size_t t = 0; t < T; ++t) {
+        const Count* col = acc.column(t);
+        int lo = acc.reach_begin[t];
+        int hi = acc.reach_end[t];
+        while (lo < hi && col[lo] < min_votes) ++lo;
+        while (hi > lo && col[hi - 1] < min_votes) --hi;
+        hot_begin_[t] = lo;
+        hot_end_[t] = hi;
+    }
+    for (size_t t = 0; t < T; ++t) {
+        int lo = R, hi = 0;
+        for (int dt = -radius; dt <= radius; ++dt) {
+            size_t nt = t + dt;
+            if (nt >= T || hot_begin_[nt] >= hot_end_[nt]) continue;
+            lo = std::min(lo, hot_begin_[nt]);
+            hi = std::max(hi, hot_end_[nt]);
+        }
+        filter_begin_[t] = lo < hi ? std::max(0, lo - radius) : 0;
+        filter_end_[t] = lo < hi ? std::min(R, hi + radius) : 0;
+    }
+
+    // Pass 1: sliding max along rho. The filtered range already includes the window
+    // padding, so clamping the window to it matches a full-column filter.
+    for (size_t t = 0; t < T; ++t) {
+        const Count* col = acc.column(t);
+        Count* out = rho_max_.data() + t * acc.rho_bins;
+        const int lo = filter_begin_[t];
+        const int hi = filter_end_[t];
+        std::copy(col + lo, col + hi, out + lo);
+        for (int d = 1; d <= radius; ++d) {
+            for (int r = lo; r + d < hi; ++r) out[r] = std::max(out[r], col[r + d]);
+            for (int r = lo + d; r < hi; ++r) out[r] = std::max(out[r], col[r - d]);
+        }
+    }
+
+    // Pass 2: max across neighbouring thetas, then compare against the column itself
+    auto weaker = [](const HoughLine& a, const HoughLine& b) { return a.votes > b.votes; };
+    for (size_t t = 0; t < T; ++t) {
+        const int lo = hot_begin_[t];
+        const int hi = hot_end_[t];
+        if (lo >= hi) continue;
+        Count* window = window_max_.data();
+        std::copy(rho_max_.begin() + t * acc.rho_bins + lo, rho_max_.begin() + t * acc.rho_bins + hi, window + lo);
+        for (int dt = -radius; dt <= radius; ++dt) {
+            size_t nt = t + dt;
+            if (dt == 0 || nt >= T) continue;
+            const Count* other = rho_max_.data() + nt * acc.rho_bins;
+            for (int r = lo; r < hi; ++r) window[r] = std::max(window[r], other[r]);
+        }
+
+        const Count* col = acc.column(t);
+        for (int r = lo; r < hi; ++r) {
+            if (col[r] < min_votes || col[r] != window[r]) continue;
+            ++candidates;
+            if (!isStrictMaximum(acc, r, t, radius)) continue;
+
+            // Bounded min-heap on votes: the weakest kept peak sits at the front
+            float votes = col[r];
+            if (peaks.size() == max_peaks) {
+                if (votes <= peaks.front().votes) continue;
+                std::pop_heap(peaks.begin(), peaks.end(), weaker);
+                peaks.pop_back();
+            }
+            peaks.push_back(HoughLine{votes, acc.rho(r), acc.thetas_rad[t]});
+            std::push_heap(peaks.begin(), peaks.end(), weaker);
+        }
+    }
+    std::sort_heap(peaks.begin(), peaks.end(), weaker);
+}
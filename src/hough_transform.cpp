@@ -1,199 +1,387 @@
 #include "hough_transform.h"
+#include "hough_accumulator.h"
+#include "thread_pool.h"
+#include "instrumentation.h"
 
 struct hough_transform_impl : public HoughTransform {
     HoughTransformConfig config_;
-    Matrix accumulator;
-    Frame lines{0,0};
+    HoughAccumulator accumulator;
+    RoiSpans roi_;
 
+    // Detected lines, strongest first. Reused every frame and only holds real peaks.
+    std::vector<HoughLine> top;
+    HoughPeakFinder peak_finder_;
+    // Always empty, the standard transform only finds infinite lines
+    std::vector<HoughSegment> segments_;
+    HoughStats stats_;
 
-    std::vector<double> rhos_;
-    std::vector<double> thetas_rad_;
-    std::vector<double> cos_t_;
-    std::vector<double> sin_t_;
-    double rho_min_ = 0.0;
-    size_t rho_bins_ = 0;
-    double cachedMinTheta_ = 1e9;
-    double cachedMaxTheta_ = 1e9;
-    double cachedAngleStep_ = 1e9;
+    std::unique_ptr<ThreadPool> pool_;
+    // Edge pixels collected from an edge map so it can share the list voting path
+    Edges frame_edges_;
+    // Pixels of an edge list that lie inside the ROI, when some don't
+    Edges roi_edges_;
+    // Accumulator writes per theta slice, summed after the parallel vote
+    std::vector<size_t> slice_votes_;
 
-    std::vector<HoughLine> top;
+    // Temporal tracking. Per theta, the rho bins [window_begin_, window_end_) can vote;
+    // window_thetas_ lists the thetas with a non-empty range.
+    std::vector<HoughLine> seeds_;
+    std::vector<std::int32_t> window_begin_;
+    std::vector<std::int32_t> window_end_;
+    std::vector<std::uint32_t> window_thetas_;
+    // Whether the accumulator holds a full search, otherwise only the window bins are dirty
+    bool full_votes_ = true;
+    int frames_since_full_ = 0;
+    size_t tracking_hits_ = 0;
+    size_t tracking_fallbacks_ = 0;
+    size_t full_searches_ = 0;
 
-    void ensureBuffers(int w, int h) {
-        if (lines.width != w || lines.height != h) {
-            lines = Frame(w, h);
+    explicit hough_transform_impl(const HoughTransformConfig& config) : config_(config) {
+        if (config_.votingThreads > 1) {
+            pool_ = std::make_unique<ThreadPool>(config_.votingThreads);
         }
+        slice_votes_.resize(std::max(1, config_.votingThreads));
+        top.reserve(std::max(0, config_.numberOfLines));
     }
 
-    void precomputeSinCosRho(int width, int height) {
-        // early exit if already computed for these parameters
-        if (cachedMinTheta_ == config_.minTheta && cachedMaxTheta_ == config_.maxTheta && cachedAngleStep_ == config_.angleStep) {
-            return;
+    void ensureRoi(int width, int height) {
+        if (roi_.width != width || roi_.height != height) {
+            roi_ = compileRoi(config_.roi, width, height);
         }
-        cachedMinTheta_ = config_.minTheta;
-        cachedMaxTheta_ = config_.maxTheta;
-        cachedAngleStep_ = config_.angleStep;
-
-        thetas_rad_.clear();
-        cos_t_.clear();
-        sin_t_.clear();
-        rhos_.clear();
+    }
 
-        for (double theta = config_.minTheta; theta <= config_.maxTheta; theta += config_.angleStep) {
-            double rad = theta * CV_PI / 180.0;
-            thetas_rad_.push_back(rad);
-            cos_t_.push_back(std::cos(rad));
-            sin_t_.push_back(std::sin(rad));
+    // Returns true if the accumulator was rebuilt, which also leaves it zeroed
+    bool ensureAccumulatorSize(int width, int height) {
+        ensureRoi(width, height);
+        if (accumulator.configure(config_, width, height, roi_.y_begin)) {
+            return true;
         }
-        const double diagLen = std::sqrt(width * width + height * height);
-        for (double r = -diagLen; r <= diagLen; r += config_.rhoStep) {
-            rhos_.push_back(r);
+        // Clear only what the last frame could touch
+        if (full_votes_) {
+            accumulator.clear();
+        } else {
+            clearWindow();
         }
-        rho_bins_ = rhos_.size();
-        rho_min_ = -diagLen;
+        return false;
     }
 
-    void ensureAccumulatorSize(int width, int height) {
+    void run(const FrameView& edges) override {
+        ensureRoi(edges.width, edges.height);
+        collectEdges(edges, roi_, frame_edges_);
+        run(frame_edges_);
+    }
 
-        precomputeSinCosRho(width, height);
-        const size_t R = rho_bins_;
-        const size_t T = thetas_rad_.size();
+    void run(const Edges& all_edges) override {
+        const bool rebuilt = ensureAccumulatorSize(all_edges.width, all_edges.height);
+        // Pixels outside the ROI would also land outside the bins clear() resets
+        const Edges& edges = edgesInRoi(all_edges, roi_, roi_edges_);
+        stats_ = HoughStats{};
+        stats_.edge_pixels = edges.size();
 
-        if (accumulator.size() != R || (R > 0 && accumulator[0].size() != T)) {
-            accumulator.assign(R, std::vector<float>(T, 0.0f));
-        } else {
-            for (auto& row : accumulator) std::fill(row.begin(), row.end(), 0.0f);
+        bool tracked = config_.temporalTracking && !rebuilt && !seeds_.empty() &&
+                       frames_since_full_ < config_.trackingRefreshInterval;
+        if (tracked) {
+            buildWindow(edges.width);
+            voteWindow(edges);
+            full_votes_ = false;
+            findLines();
+            if (trackingConfident()) {
+                ++tracking_hits_;
+                ++frames_since_full_;
+            } else {
+                // Lost a lane or the window drifted off it: start over from a full search
+                ++tracking_fallbacks_;
+                clearWindow();
+                tracked = false;
+            }
         }
-        
-    }
+        if (!tracked) {
+            voteEdges(edges);
+            full_votes_ = true;
+            findLines();
+            ++full_searches_;
+            frames_since_full_ = 0;
+        }
+        seeds_.assign(top.begin(), top.end());
 
-    Frame run(const Frame& edges) override {
-        ensureBuffers(edges.width, edges.height);
-        std::fill(lines.pixels.begin(), lines.pixels.end(), 0);
-        ensureAccumulatorSize(edges.width, edges.height);
-        transformEdges(edges, lines);
-        return lines;
+        stats_.tracked = tracked;
+        stats_.tracking_hits = tracking_hits_;
+        stats_.tracking_fallbacks = tracking_fallbacks_;
+        stats_.full_searches = full_searches_;
+        CLT_RECORD(VotesCast, stats_.votes_cast);
+        CLT_RECORD(PeaksFound, top.size());
     }
 
-    inline int rhoIndex(double rho) {
-        return (int)std::lround((rho - rho_min_) / config_.rhoStep);
+    void voteEdges(const Edges& edges) {
+        CLT_SCOPED_TIMER(HoughVoting);
+        const bool oriented = config_.orientedVoting && edges.hasDirections();
+        forEachSlice(accumulator.theta_bins, [&](size_t theta_begin, size_t theta_end) {
+            return oriented ? voteOriented(edges, theta_begin, theta_end)
+                            : voteAll(edges, theta_begin, theta_end);
+        });
     }
 
-    inline void votePixel(int x, int y) {
-        for (size_t theta_idx = 0; theta_idx < thetas_rad_.size(); ++theta_idx) {
-            double rho = x * cos_t_[theta_idx] + y * sin_t_[theta_idx];
-            // find the closest rho index
-            int rho_idx = rhoIndex(rho);
-            if (rho_idx < accumulator.size()) {
-                accumulator[(size_t)rho_idx][theta_idx] += 1.0f;
-            }
+    // Splits [0, count) into one contiguous slice per voting thread and adds up the votes
+    template <typename VoteFn>
+    void forEachSlice(size_t count, VoteFn&& vote) {
+        const int slices = static_cast<int>(slice_votes_.size());
+        auto vote_slice = [&](int slice) {
+            slice_votes_[slice] = vote(count * slice / slices, count * (slice + 1) / slices);
+        };
+        if (pool_) {
+            pool_->parallelFor(slices, vote_slice);
+        } else {
+            vote_slice(0);
+        }
+        for (size_t votes : slice_votes_) {
+            stats_.votes_cast += votes;
         }
     }
 
-    void transformEdges(const Frame& edges, Frame& lines) {
-        top.clear();
-        top.resize(config_.numberOfLines, HoughLine{0,0,0});
+    size_t voteAll(const Edges& edges, size_t theta_begin, size_t theta_end) {
+        size_t votes = 0;
+        for (size_t i = 0; i < edges.size(); ++i) {
+            accumulator.vote(edges.xs[i], edges.ys[i], theta_begin, theta_end);
+            votes += theta_end - theta_begin;
+        }
+        return votes;
+    }
 
-        int y0 = ImageMask::getMaskStartY(edges.height);
-        for (int y = y0; y < edges.height; ++y) {
-            for (int x = 0; x < edges.width; ++x) {
-                if (edges.at(x, y) == 0) continue;
-                votePixel(x, y);
-            }
+    // The gradient angle is the line's normal, so only thetas near it can collect a real vote.
+    // Angles past maxTheta fold back to the negative end of the range. When the range spans
+    // the whole 180 degrees, a window running off one end carries on at the other, which
+    // holds the same orientations with rho negated.
+    size_t voteOriented(const Edges& edges, size_t theta_begin, size_t theta_end) {
+        const long window = config_.orientedVotingWindow;
+        const long bins = static_cast<long>(accumulator.theta_bins);
+        const long period = std::lround(180.0 / config_.angleStep);
+        const bool wraps = bins >= period;
+        // A window as wide as the period would vote some bins twice
+        if (wraps && 2 * window + 1 >= period) return voteAll(edges, theta_begin, theta_end);
+        size_t votes = 0;
+        // Votes in the bins of [first, last] that belong to this slice
+        auto vote = [&](int x, int y, long first, long last) {
+            first = std::max(static_cast<long>(theta_begin), first);
+            last = std::min(static_cast<long>(theta_end) - 1, last);
+            if (first > last) return;
+            accumulator.vote(x, y, static_cast<size_t>(first), static_cast<size_t>(last) + 1);
+            votes += static_cast<size_t>(last - first + 1);
+        };
+        for (size_t i = 0; i < edges.size(); ++i) {
+            const uint8_t gradient_deg = edges.dirs[i];
+            double theta = gradient_deg > config_.maxTheta ? gradient_deg - 180.0 : gradient_deg;
+            const long center = std::lround((theta - config_.minTheta) / config_.angleStep);
+            const long first = center - window, last = center + window;
+            vote(edges.xs[i], edges.ys[i], std::max(0L, first), std::min(bins - 1, last));
+            if (!wraps) continue;
+            if (first < 0) vote(edges.xs[i], edges.ys[i], first + period, period - 1);
+            if (last >= bins) vote(edges.xs[i], edges.ys[i], bins - period, last - period);
         }
-        // Get the theta and rho with votes above threshold and draw lines
-        for (size_t r = 0; r < accumulator.size(); ++r) {
-            for (size_t t = 0; t < accumulator[r].size(); ++t) {
-                if (accumulator[r][t] >= config_.lineThreshold && isLocalMaximum(r, t)) {
-                    float votes = accumulator[r][t];
-                    double rho = rhos_[r];
-                    double theta = thetas_rad_[t];
-                    insertTopN(top, votes, rho, theta);
+        return votes;
+    }
+
+    // The window follows each previous line as it turns about its point nearest the
+    // middle of the voting region, so its rho range stays centred on the line for every
+    // theta in the margin. It is clamped at the ends of the theta range.
+    void buildWindow(int width) {
+        clearWindow();
+        const size_t T = accumulator.theta_bins;
+        window_begin_.assign(T, 0);
+        window_end_.assign(T, 0);
+
+        const long theta_margin = std::lround(config_.trackingThetaMargin / config_.angleStep);
+        const double rho_margin = config_.trackingRhoMargin / accumulator.rho_step;
+        const double cx = 0.5 * (width - 1);
+        const double cy = 0.5 * (roi_.y_begin + roi_.y_end - 1);
+        for (const auto& seed : seeds_) {
+            const double c = std::cos(seed.theta), s = std::sin(seed.theta);
+            const double d = cx * c + cy * s - seed.rho;
+            const double px = cx - d * c, py = cy - d * s;
+
+            const long center = std::lround((seed.theta * 180.0 / CV_PI - config_.minTheta) / config_.angleStep);
+            const long first = std::max(0L, center - theta_margin);
+            const long last = std::min(static_cast<long>(T) - 1, center + theta_margin);
+            for (long t = first; t <= last; ++t) {
+                const double theta = accumulator.thetas_rad[t];
+                const double r = (px * std::cos(theta) + py * std::sin(theta) - accumulator.rho_min) / accumulator.rho_step;
+                std::int32_t lo = std::max(accumulator.reach_begin[t], static_cast<std::int32_t>(std::floor(r - rho_margin)));
+                std::int32_t hi = std::min(accumulator.reach_end[t], static_cast<std::int32_t>(std::ceil(r + rho_margin)) + 1);
+                if (lo >= hi) continue;
+                if (window_begin_[t] < window_end_[t]) {
+                    lo = std::min(lo, window_begin_[t]);
+                    hi = std::max(hi, window_end_[t]);
                 }
+                window_begin_[t] = lo;
+                window_end_[t] = hi;
             }
         }
-        for (const auto& line : top) {
-            if (line.votes <= 0) continue;
-            drawLines(lines, line.rho, line.theta);
+        for (size_t t = 0; t < T; ++t) {
+            if (window_begin_[t] < window_end_[t]) window_thetas_.push_back(static_cast<std::uint32_t>(t));
         }
     }
+
+    void clearWindow() {
+        for (std::uint32_t t : window_thetas_) {
+            HoughAccumulator::Count* col = accumulator.column(t);
+            std::fill(col + window_begin_[t], col + window_end_[t], 0);
+        }
+        window_thetas_.clear();
+    }
+
+    // Gradient directions are not used here, the theta window is already narrower
+    // than the oriented voting one
+    void voteWindow(const Edges& edges) {
+        CLT_SCOPED_TIMER(HoughVoting);
+        forEachSlice(window_thetas_.size(), [&](size_t first, size_t last) {
+            size_t votes = 0;
+            for (size_t k = first; k < last; ++k) {
+                const size_t t = window_thetas_[k];
+                HoughAccumulator::Count* col = accumulator.column(t);
+                const std::int32_t lo = window_begin_[t];
+                const std::uint32_t span = static_cast<std::uint32_t>(window_end_[t] - lo);
+                for (size_t i = 0; i < edges.size(); ++i) {
+                    const std::int32_t r = accumulator.rhoIndex(t, edges.xs[i], edges.ys[i]);
+                    if (static_cast<std::uint32_t>(r - lo) < span) {
+                        ++col[r];
+                        ++votes;
+                    }
+                }
+            }
+            return votes;
+        });
+    }
+
+    bool trackingConfident() const {
+        const size_t min_lines = std::min(seeds_.size(), static_cast<size_t>(std::max(0, config_.trackingMinLines)));
+        if (top.size() < min_lines) return false;
+        if (seeds_.empty()) return true;
+        // Both lists are sorted strongest first
+        const float previous = seeds_.front().votes;
+        return !top.empty() && top.front().votes >= config_.trackingMinVoteRatio * previous;
+    }
+
+    void findLines() {
+        CLT_SCOPED_TIMER(PeakSearch);
+        peak_finder_.find(accumulator, config_.lineThreshold, config_.peakWindow,
+                          static_cast<size_t>(std::max(0, config_.numberOfLines)), top);
+        stats_.peak_candidates += peak_finder_.candidates;
+    }
     // Check if there are 
     bool checkLineValidity(size_t r_idx, size_t t_idx) {
         // Placeholder for line validity check, e.g., based on slope or position
         return true;
     }
 
-    bool isLocalMaximum(size_t r_idx, size_t t_idx) {
-        float current_value = accumulator[r_idx][t_idx];
-        for (int dr = -3; dr <= 3; ++dr) {
-            for (int dt = -3; dt <= 3; ++dt) {
-                if (dr == 0 && dt == 0) continue;
-                size_t neighbor_r = r_idx + dr;
-                size_t neighbor_t = t_idx + dt;
-                if (neighbor_r < 0 || neighbor_r >= accumulator.size() ||
-                    neighbor_t < 0 || neighbor_t >= accumulator[0].size()) {
-                    continue;
-                }
-                if (accumulator[neighbor_r][neighbor_t] >= current_value) {
-                    return false;
-                }
-            }
-        }
-        return true;
+    const std::vector<HoughLine>& getDetectedLines() const override {
+        return top;
     }
 
-    void drawLines(Frame& lines, double rho, double theta) {
-        // set the pixels in lines frame corresponding to the line defined by (rho, theta) to 255
-        double a = std::cos(theta), b = std::sin(theta);
-        double x0 = a * rho, y0 = b * rho;
-        int L = std::max(lines.width, lines.height);
-        int x1 = static_cast<int>(x0 + L * (-b));
-        int y1 = static_cast<int>(y0 + L * (a));
-        int x2 = static_cast<int>(x0 - L * (-b));
-        int y2 = static_cast<int>(y0 - L * (a));
+    const std::vector<HoughSegment>& getDetectedSegments() const override {
+        return segments_;
+    }
 
-        // Draw the line on the lines frame
-        drawLine(lines, x1, y1, x2, y2);
+    const HoughStats& getStats() const override {
+        return stats_;
     }
 
-    void drawLine(Frame& frame, int x0, int y0, int x1, int y1) {
-        const int ymin =ImageMask::getMaskStartY(frame.height); 
-        cv::Point p0(x0, y0), p1(x1, y1);
+    const RoiSpans& getRoi() const override {
+        return roi_;
+    }
+};
+
 
-        // Clip to image bounds; if no intersection, nothing to draw
-        if (!cv::clipLine(cv::Size(frame.width, frame.height), p0, p1)) {
-            return;
+void collectEdges(const FrameView& edge_map, const RoiSpans& roi, Edges& edges) {
+    edges.clear();
+    edges.width = edge_map.width;
+    edges.height = edge_map.height;
+    for (int y = roi.y_begin; y < roi.y_end; ++y) {
+        const uint8_t* row = edge_map.row(y);
+        const RowSpan& span = roi.row(y);
+        for (int x = span.begin; x < span.end; ++x) {
+            if (row[x] == 0) continue;
+            edges.xs.push_back(static_cast<uint16_t>(x));
+            edges.ys.push_back(static_cast<uint16_t>(y));
         }
-        x0 = p0.x; y0 = p0.y;
-        x1 = p1.x; y1 = p1.y;
+    }
+}
 
-        int dx = std::abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
-        int dy = -std::abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
-        int err = dx + dy, e2;
+const Edges& edgesInRoi(const Edges& edges, const RoiSpans& roi, Edges& scratch) {
+    size_t i = 0;
+    while (i < edges.size() && roi.contains(edges.xs[i], edges.ys[i])) ++i;
+    if (i == edges.size()) return edges;
 
-        while(true)
-        {
-            if (y0 >= ymin ) {
-                frame.at(x0, y0) = 255;
-            }
-            if (x0 == x1 && y0 == y1) break;
-            e2 = 2 * err;
-            if (e2 >= dy) { err += dy; x0 += sx; }
-            if (e2 <= dx) { err += dx; y0 += sy; }
+    const bool directions = edges.hasDirections();
+    scratch.clear();
+    scratch.width = edges.width;
+    scratch.height = edges.height;
+    for (i = 0; i < edges.size(); ++i) {
+        if (!roi.contains(edges.xs[i], edges.ys[i])) continue;
+        scratch.xs.push_back(edges.xs[i]);
+        scratch.ys.push_back(edges.ys[i]);
+        if (directions) scratch.dirs.push_back(edges.dirs[i]);
+    }
+    return scratch;
+}
+
+void drawDetectedLines(const FrameView& frame, const HoughTransform& hough) {
+    const RoiSpans& roi = hough.getRoi();
+    if (roi.width != frame.width || roi.height != frame.height) return;
+    const auto& segments = hough.getDetectedSegments();
+    if (!segments.empty()) {
+        for (const auto& segment : segments) {
+            drawLineSegment(frame, roi, segment.x0, segment.y0, segment.x1, segment.y1);
         }
+        return;
+    }
+    for (const auto& line : hough.getDetectedLines()) {
+        int x1, y1, x2, y2;
+        lineEndpoints(line, frame.width, frame.height, x1, y1, x2, y2);
+        drawLineSegment(frame, roi, x1, y1, x2, y2);
     }
+}
 
-    static void insertTopN(std::vector<HoughLine>& top, float votes, double rho, double theta) {
-        if (votes <= top.back().votes) return;
-        top.back() = HoughLine{votes, rho, theta};
-        std::sort(top.begin(), top.end(), [](const HoughLine& a, const HoughLine& b) {
-            return a.votes > b.votes;
-        });
+void lineEndpoints(const HoughLine& line, int width, int height, int& x0, int& y0, int& x1, int& y1) {
+    double a = std::cos(line.theta), b = std::sin(line.theta);
+    double cx = a * line.rho, cy = b * line.rho;
+    int L = std::max(width, height);
+    x0 = static_cast<int>(cx + L * (-b));
+    y0 = static_cast<int>(cy + L * (a));
+    x1 = static_cast<int>(cx - L * (-b));
+    y1 = static_cast<int>(cy - L * (a));
+}
+
+void drawLineSegment(const FrameView& frame, const RoiSpans& roi, int x0, int y0, int x1, int y1) {
+    cv::Point p0(x0, y0), p1(x1, y1);
+
+    // Clip to image bounds, then to the ROI; if no intersection, nothing to draw
+    if (!cv::clipLine(cv::Size(frame.width, frame.height), p0, p1)) {
+        return;
+    }
+    x0 = p0.x; y0 = p0.y;
+    x1 = p1.x; y1 = p1.y;
+    if (!clipToRoi(roi, x0, y0, x1, y1)) {
+        return;
     }
 
-    const std::vector<HoughLine>& getDetectedLines() const override {
-        return top;
+    int dx = std::abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int dy = -std::abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy, e2;
+
+    while(true)
+    {
+        if (roi.contains(x0, y0)) {
+            frame.at(x0, y0) = 255;
+        }
+        if (x0 == x1 && y0 == y1) break;
+        e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x0 += sx; }
+        if (e2 <= dx) { err += dx; y0 += sy; }
     }
-};
-std::unique_ptr<HoughTransform> createHoughTransform() {
-    return std::make_unique<hough_transform_impl>();
+}
+
+std::unique_ptr<HoughTransform> createHoughTransform(const HoughTransformConfig& config, HoughTransformType type) {
+    if (type == HoughTransformType::Progressive) {
+        return createProgressiveHoughTransform(config);
+    }
+    return std::make_unique<hough_transform_impl>(config);
 }
\ No newline at end of file
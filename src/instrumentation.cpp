@@ -0,0 +1,166 @@
+#include "instrumentation.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+namespace {
+
+// Log-linear buckets: values below 8 get their own bucket, above that every power of two
+// is split into 8, which bounds the relative bucket width to 12.5%
+constexpr int kSubBits = 3;
+constexpr int kSubBuckets = 1 << kSubBits;
+constexpr int kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+struct Histogram {
+    std::atomic<std::uint64_t> buckets[kBuckets];
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> sum{0};
+    std::atomic<std::uint64_t> max{0};
+};
+
+constexpr int kMetricCount = static_cast<int>(Metric::Count);
+Histogram histograms[kMetricCount];
+
+const char* const kMetricNames[kMetricCount] = {
+    "decode", "gray_convert", "downscale", "line_refine", "gaussian_smoothing", "sobel_filter", "non_maximum_suppression", "hysteresis",
+    "blur_sobel_nms", "hough_voting", "peak_search", "lane_tracking", "render", "edge_pixels", "high_threshold", "low_threshold", "votes_cast", "peaks_found",
+};
+
+bool isTime(Metric metric) {
+    return metric < Metric::EdgePixels;
+}
+
+int bucketIndex(std::uint64_t value) {
+    if (value < kSubBuckets) return static_cast<int>(value);
+    const int exponent = 63 - __builtin_clzll(value);
+    const int sub = static_cast<int>((value >> (exponent - kSubBits)) & (kSubBuckets - 1));
+    return (exponent - kSubBits + 1) * kSubBuckets + sub;
+}
+
+double bucketMidpoint(int index) {
+    if (index < kSubBuckets) return index;
+    const int exponent = index / kSubBuckets + kSubBits - 1;
+    const int sub = index % kSubBuckets;
+    const double width = std::ldexp(1.0, exponent - kSubBits);
+    return std::ldexp(1.0, exponent) + (sub + 0.5) * width;
+}
+
+// Percentiles of the given bucket counts, capped at max
+void fillPercentiles(const std::uint64_t* counts, std::uint64_t total, MetricSummary& summary) {
+    const double ranks[3] = {0.50, 0.95, 0.99};
+    double* outputs[3] = {&summary.p50, &summary.p95, &summary.p99};
+    std::uint64_t seen = 0;
+    int next = 0;
+    for (int i = 0; i < kBuckets && next < 3; ++i) {
+        seen += counts[i];
+        while (next < 3 && seen >= ranks[next] * total) {
+            *outputs[next++] = std::min(bucketMidpoint(i), static_cast<double>(summary.max));
+        }
+    }
+}
+
+// Summary of what was recorded since window's last snapshot, which it then moves up to now
+MetricSummary summarizeWindow(Metric metric, std::uint64_t* snapshot) {
+    const Histogram& h = histograms[static_cast<int>(metric)];
+    MetricSummary summary;
+    summary.name = kMetricNames[static_cast<int>(metric)];
+    summary.is_time = isTime(metric);
+    std::uint64_t counts[kBuckets];
+    std::uint64_t total = 0;
+    int highest = -1;
+    for (int i = 0; i < kBuckets; ++i) {
+        const std::uint64_t current = h.buckets[i].load(std::memory_order_relaxed);
+        counts[i] = current - snapshot[i];
+        snapshot[i] = current;
+        total += counts[i];
+        if (counts[i] > 0) highest = i;
+    }
+    summary.count = total;
+    if (total == 0) return summary;
+    // The recorded max covers the whole run, the window's own is only known to its bucket
+    const std::uint64_t max = h.max.load(std::memory_order_relaxed);
+    summary.max = std::min(static_cast<std::uint64_t>(bucketMidpoint(highest)), max);
+    fillPercentiles(counts, total, summary);
+    return summary;
+}
+
+}
+
+void recordMetric(Metric metric, std::uint64_t value) {
+    Histogram& h = histograms[static_cast<int>(metric)];
+    h.buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    h.count.fetch_add(1, std::memory_order_relaxed);
+    h.sum.fetch_add(value, std::memory_order_relaxed);
+    std::uint64_t current = h.max.load(std::memory_order_relaxed);
+    while (value > current && !h.max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+MetricSummary summarizeMetric(Metric metric) {
+    const Histogram& h = histograms[static_cast<int>(metric)];
+    MetricSummary summary;
+    summary.name = kMetricNames[static_cast<int>(metric)];
+    summary.is_time = isTime(metric);
+    // Snapshot the buckets first, the total is taken from them so percentiles stay consistent
+    // while other threads keep recording
+    std::uint64_t counts[kBuckets];
+    std::uint64_t total = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        counts[i] = h.buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    summary.count = total;
+    summary.max = h.max.load(std::memory_order_relaxed);
+    if (total == 0) return summary;
+    summary.mean = static_cast<double>(h.sum.load(std::memory_order_relaxed)) / h.count.load(std::memory_order_relaxed);
+    fillPercentiles(counts, total, summary);
+    return summary;
+}
+
+void resetMetrics() {
+    for (Histogram& h : histograms) {
+        for (auto& bucket : h.buckets) bucket.store(0, std::memory_order_relaxed);
+        h.count.store(0, std::memory_order_relaxed);
+        h.sum.store(0, std::memory_order_relaxed);
+        h.max.store(0, std::memory_order_relaxed);
+    }
+}
+
+void logMetrics(std::ostream& out, MetricWindow* window) {
+    out << (window ? "p50/p95/p99/max since last report:" : "p50/p95/p99/max over the run:");
+    if (window) window->buckets.resize(static_cast<size_t>(kMetricCount) * kBuckets, 0);
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out << std::fixed;
+    for (int m = 0; m < kMetricCount; ++m) {
+        const Metric metric = static_cast<Metric>(m);
+        MetricSummary s = window ? summarizeWindow(metric, window->buckets.data() + static_cast<size_t>(m) * kBuckets)
+                                 : summarizeMetric(metric);
+        if (s.count == 0) continue;
+        // Times in milliseconds, counts as they are
+        const double scale = s.is_time ? 1e-6 : 1.0;
+        out << std::setprecision(s.is_time ? 2 : 0) << " " << s.name << " " << s.p50 * scale << "/" << s.p95 * scale
+            << "/" << s.p99 * scale << "/" << s.max * scale << (s.is_time ? "ms" : "");
+    }
+    out.flags(flags);
+    out.precision(precision);
+    out << std::endl;
+}
+
+bool writeMetricsJson(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "{\n  \"metrics\": [";
+    bool first = true;
+    for (int m = 0; m < kMetricCount; ++m) {
+        MetricSummary s = summarizeMetric(static_cast<Metric>(m));
+        if (s.count == 0) continue;
+        out << (first ? "\n" : ",\n") << "    {\"name\": \"" << s.name << "\", \"unit\": \"" << (s.is_time ? "ns" : "count")
+            << "\", \"count\": " << s.count << ", \"mean\": " << s.mean << ", \"p50\": " << s.p50 << ", \"p95\": " << s.p95
+            << ", \"p99\": " << s.p99 << ", \"max\": " << s.max << "}";
+        first = false;
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
@@ -1,99 +1,218 @@
 #include <iostream>
 #include "video_service.h"
+#include "video_pipeline.h"
 #include "canny_edge_detection.h"
 #include "hough_transform.h"
+#include "batch_processor.h"
+#include "frame_cache.h"
+#include "instrumentation.h"
 #include <memory>
 #include <yaml-cpp/yaml.h>
-#include <opencv2/opencv.hpp>
-#include <chrono>
 
-class VideoPipeline {
-public:
-    VideoPipeline(std::unique_ptr<VideoService> video_service, std::unique_ptr<CannyEdgeDetection> canny_edge_detector, std::unique_ptr<HoughTransform> hough_transform)
-        : video_service_(std::move(video_service)), canny_edge_detector_(std::move(canny_edge_detector)), hough_transform_(std::move(hough_transform)) {}
-
-    void run(const std::string& video_path) {
-        if (!video_service_->initialize(video_path)) {
-            std::cerr << "Failed to initialize video service." << std::endl;
-            return;
+VideoPipelineConfig loadPipelineConfig(const YAML::Node& node) {
+    VideoPipelineConfig config;
+    if (!node) return config;
+    if (node["threaded"]) config.threaded = node["threaded"].as<bool>();
+    if (node["queue_depth"]) config.queue_depth = node["queue_depth"].as<int>();
+    if (node["report_interval"]) config.report_interval = node["report_interval"].as<int>();
+    if (node["display"]) config.display = node["display"].as<bool>();
+    if (node["display_max_fps"]) config.display_max_fps = node["display_max_fps"].as<double>();
+    if (node["drop_policy"]) {
+        std::string policy = node["drop_policy"].as<std::string>();
+        if (policy == "drop_newest") {
+            config.drop_policy = FrameDropPolicy::DropNewest;
+        } else if (policy != "block") {
+            std::cerr << "Unknown drop_policy '" << policy << "', using block." << std::endl;
         }
-
-        auto start_time = std::chrono::high_resolution_clock::now();
-        cv::Mat cv_frame;
-        Frame frame(0,0);
-        int frame_count = 0;
-
-        while (video_service_->hasMoreFrames()) {
-            cv_frame = video_service_->getFrame();
-            frame = Frame::fromMat(cv_frame);
-            auto process_start = std::chrono::high_resolution_clock::now();
-            processFrame(frame);
-            auto process_end = std::chrono::high_resolution_clock::now();
-
-            frame_count++;
-            if (frame_count % 30 == 0) {
-                auto end_time = std::chrono::high_resolution_clock::now();
-                auto total_duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-                auto process_duration = std::chrono::duration_cast<std::chrono::milliseconds>(process_end - process_start);
-                
-                double fps = 30000.0 / total_duration.count();
-                std::cout << "FPS: " << fps << ", Processing time: " << process_duration.count() << "ms" << std::endl;
-                start_time = end_time;
-            }
+    }
+    return config;
+}
+
+VideoServiceConfig loadVideoConfig(const YAML::Node& node) {
+    VideoServiceConfig config;
+    if (!node) return config;
+    if (node["luma"]) config.luma = node["luma"].as<bool>();
+    if (node["crop_to_roi"]) config.crop_to_roi = node["crop_to_roi"].as<bool>();
+    if (node["roi_margin"]) config.roi_margin = node["roi_margin"].as<int>();
+    if (node["prefetch_frames"]) config.prefetch_frames = node["prefetch_frames"].as<int>();
+    return config;
+}
+
+// polygon: list of [x, y], trapezoid: top, bottom, top_width, bottom_width and
+// optionally center, all in fractions of the frame size
+RoiConfig loadRoiConfig(const YAML::Node& node) {
+    RoiConfig roi;
+    if (!node) return roi;
+    if (node["polygon"]) {
+        for (const auto& point : node["polygon"]) {
+            roi.polygon.push_back(RoiPoint{point[0].as<double>(), point[1].as<double>()});
         }
-
-
-        video_service_->releaseFrame(cv_frame);
+        if (roi.polygon.size() < 3) {
+            std::cerr << "roi polygon needs at least 3 points, using the lower half." << std::endl;
+            roi.polygon.clear();
+        }
+    } else if (const YAML::Node trapezoid = node["trapezoid"]) {
+        roi = RoiConfig::trapezoid(trapezoid["top"].as<double>(0.5), trapezoid["bottom"].as<double>(1.0),
+                                   trapezoid["top_width"].as<double>(1.0), trapezoid["bottom_width"].as<double>(1.0),
+                                   trapezoid["center"].as<double>(0.5));
     }
-
-private:
-    void processFrame(const Frame& frame) {
-        // Show data
-        Frame edges = canny_edge_detector_->run(frame);
-        Frame lines = hough_transform_->run(edges);
-        cv::Mat orig = Frame::toMat(frame);   // original frame
-        cv::Mat lineImg = Frame::toMat(lines); // grayscale line image (0..255)
-
-        // Ensure orig is 3-channel BGR for colored overlay
-        cv::Mat origBgr;
-        if (orig.channels() == 1) {
-            cv::cvtColor(orig, origBgr, cv::COLOR_GRAY2BGR);
-        } else {
-            origBgr = orig.clone();
+    return roi;
+}
+
+PyramidConfig loadPyramidConfig(const YAML::Node& node) {
+    PyramidConfig config;
+    if (!node) return config;
+    if (node["factor"]) config.factor = std::max(1, node["factor"].as<int>());
+    if (node["refine_radius"]) config.refine_radius = node["refine_radius"].as<int>();
+    if (node["refine_min_gradient"]) config.refine_min_gradient = node["refine_min_gradient"].as<int>();
+    if (node["refine_min_points"]) config.refine_min_points = node["refine_min_points"].as<int>();
+    return config;
+}
+
+CannyEdgeConfig loadCannyConfig(const YAML::Node& node) {
+    CannyEdgeConfig config;
+    if (!node) return config;
+    if (node["high_threshold"]) config.high_threshold = node["high_threshold"].as<double>();
+    if (node["low_threshold"]) config.low_threshold = node["low_threshold"].as<double>();
+    if (node["sigma"]) config.sigma = node["sigma"].as<double>();
+    if (node["tiled"]) config.tiled = node["tiled"].as<bool>();
+    if (node["threads"]) config.threads = node["threads"].as<int>();
+    if (node["edge_budget"]) config.edge_budget = node["edge_budget"].as<int>();
+    if (node["min_high_threshold"]) config.min_high_threshold = node["min_high_threshold"].as<double>();
+    if (node["max_high_threshold"]) config.max_high_threshold = node["max_high_threshold"].as<double>();
+    if (node["threshold_smoothing"]) config.threshold_smoothing = node["threshold_smoothing"].as<double>();
+    if (node["edge_directions"]) config.edge_directions = node["edge_directions"].as<bool>();
+    return config;
+}
+
+// Keys are named after the HoughTransformConfig fields
+HoughTransformConfig loadHoughConfig(const YAML::Node& node) {
+    HoughTransformConfig config;
+    if (!node) return config;
+    if (node["orientedVoting"]) config.orientedVoting = node["orientedVoting"].as<bool>();
+    if (node["orientedVotingWindow"]) config.orientedVotingWindow = node["orientedVotingWindow"].as<int>();
+    if (node["votingThreads"]) config.votingThreads = node["votingThreads"].as<int>();
+    if (node["minLineLength"]) config.minLineLength = node["minLineLength"].as<int>();
+    if (node["maxLineGap"]) config.maxLineGap = node["maxLineGap"].as<int>();
+    if (node["temporalTracking"]) config.temporalTracking = node["temporalTracking"].as<bool>();
+    if (node["trackingThetaMargin"]) config.trackingThetaMargin = node["trackingThetaMargin"].as<double>();
+    if (node["trackingRhoMargin"]) config.trackingRhoMargin = node["trackingRhoMargin"].as<double>();
+    if (node["trackingRefreshInterval"]) config.trackingRefreshInterval = node["trackingRefreshInterval"].as<int>();
+    if (node["trackingMinLines"]) config.trackingMinLines = node["trackingMinLines"].as<int>();
+    if (node["trackingMinVoteRatio"]) config.trackingMinVoteRatio = node["trackingMinVoteRatio"].as<double>();
+    return config;
+}
+
+HoughTransformType loadHoughType(const YAML::Node& node) {
+    if (!node || !node["type"]) return HoughTransformType::Standard;
+    std::string type = node["type"].as<std::string>();
+    if (type == "progressive") return HoughTransformType::Progressive;
+    if (type != "standard") {
+        std::cerr << "Unknown hough type '" << type << "', using standard." << std::endl;
+    }
+    return HoughTransformType::Standard;
+}
+
+ParticleFilterConfig loadTrackerConfig(const YAML::Node& node) {
+    ParticleFilterConfig config;
+    if (!node) return config;
+    if (node["particles"]) config.particles = node["particles"].as<int>();
+    if (node["threads"]) config.threads = node["threads"].as<int>();
+    if (node["sample_rows"]) config.sample_rows = node["sample_rows"].as<int>();
+    if (node["top_noise"]) config.top_noise = node["top_noise"].as<double>();
+    if (node["bottom_noise"]) config.bottom_noise = node["bottom_noise"].as<double>();
+    if (node["roughening"]) config.roughening = node["roughening"].as<double>();
+    if (node["lock_confidence"]) config.lock_confidence = node["lock_confidence"].as<double>();
+    if (node["unlock_confidence"]) config.unlock_confidence = node["unlock_confidence"].as<double>();
+    if (node["full_search_interval"]) config.full_search_interval = node["full_search_interval"].as<int>();
+    return config;
+}
+
+BatchConfig loadBatchConfig(const YAML::Node& node) {
+    BatchConfig config;
+    if (!node) return config;
+    if (node["output_dir"]) config.output_dir = node["output_dir"].as<std::string>();
+    if (node["streams"]) config.streams = node["streams"].as<int>();
+    if (node["report_interval"]) config.report_interval = node["report_interval"].as<double>();
+    if (node["format"]) {
+        std::string format = node["format"].as<std::string>();
+        if (format == "binary") {
+            config.format = LineOutputFormat::Binary;
+        } else if (format != "csv") {
+            std::cerr << "Unknown batch format '" << format << "', using csv." << std::endl;
         }
-
-        // Convert line image to BGR and colorize it (optional)
-        cv::Mat linesBgr;
-        cv::cvtColor(lineImg, linesBgr, cv::COLOR_GRAY2BGR);
-
-        cv::Mat mask;
-        cv::threshold(lineImg, mask, 1, 255, cv::THRESH_BINARY);
-        cv::Mat redLines = cv::Mat::zeros(linesBgr.size(), linesBgr.type());
-        redLines.setTo(cv::Scalar(0, 0, 255), mask); // BGR: red where mask is true
-
-        // Blend
-        cv::Mat overlay;
-        cv::addWeighted(origBgr, 1.0, redLines, 1.0, 0.0, overlay);
-
-        cv::imshow("Overlay (Hough lines)", overlay);
-        cv::waitKey(1);
     }
+    if (node["inputs"]) {
+        for (const auto& input : node["inputs"]) config.inputs.push_back(input.as<std::string>());
+    }
+    return config;
+}
+
+// Writes the stage metrics as JSON to instrumentation_dump from the config, if set
+void dumpMetrics(const YAML::Node& config) {
+#if CANNY_LANE_TRACKER_INSTRUMENTATION
+    if (!config["instrumentation_dump"]) return;
+    std::string path = config["instrumentation_dump"].as<std::string>();
+    if (!writeMetricsJson(path)) {
+        std::cerr << "Failed to write " << path << std::endl;
+    }
+#endif
+}
 
-    std::unique_ptr<VideoService> video_service_;
-    std::unique_ptr<CannyEdgeDetection> canny_edge_detector_;
-    std::unique_ptr<HoughTransform> hough_transform_;
-};
-
-
-int main () {
+// canny_lane_tracker                      shows video_file from the config
+// canny_lane_tracker --batch [inputs...]  headless, inputs default to batch.inputs
+int main (int argc, char** argv) {
     YAML::Node config = YAML::LoadFile("../config/main.yaml");
+    const RoiConfig roi = loadRoiConfig(config["roi"]);
+    const PyramidConfig pyramid = loadPyramidConfig(config["pyramid"]);
+    VideoServiceConfig video_config = loadVideoConfig(config["video"]);
+    video_config.roi = roi;
+    CannyEdgeConfig canny_config = loadCannyConfig(config["canny"]);
+    canny_config.roi = roi;
+    HoughTransformConfig hough_config = loadHoughConfig(config["hough"]);
+    hough_config.roi = roi;
+    const HoughTransformType hough_type = loadHoughType(config["hough"]);
+    // Oriented voting needs the gradient direction of every edge pixel
+    if (hough_config.orientedVoting) canny_config.edge_directions = true;
+
+    if (argc > 1 && std::string(argv[1]) == "--batch") {
+        BatchConfig batch_config = loadBatchConfig(config["batch"]);
+        batch_config.video = video_config;
+        batch_config.canny = canny_config;
+        batch_config.hough = hough_config;
+        batch_config.hough_type = hough_type;
+        batch_config.pyramid = pyramid;
+        if (argc > 2) batch_config.inputs.assign(argv + 2, argv + argc);
+        BatchStats stats = runBatch(batch_config);
+        std::cout << "Batch done: " << stats.videos - stats.failed << "/" << stats.videos << " videos, "
+                  << stats.frames << " frames in " << stats.seconds << "s, "
+                  << (stats.seconds > 0.0 ? stats.frames / stats.seconds : 0.0) << " fps" << std::endl;
+#if CANNY_LANE_TRACKER_INSTRUMENTATION
+        logMetrics(std::cout);
+#endif
+        dumpMetrics(config);
+        return stats.failed == 0 ? 0 : 1;
+    }
+
     std::string video_path = config["video_file"].as<std::string>();
     
 
-    auto video_service = createVideoService();
-    auto canny_edge_detector = createCannyEdgeDetection();
-    auto hough_transform = createHoughTransform();
-    VideoPipeline pipeline(std::move(video_service), std::move(canny_edge_detector), std::move(hough_transform));
+    // Decoded frame caches from tools/frame_cache replay without the decoder
+    auto video_service = isFrameCachePath(video_path) ? createFrameCacheVideoService() : createVideoService(video_config);
+    if (pyramid.factor > 1) canny_config.skip_blur_border = true;
+    auto canny_edge_detector = createCannyEdgeDetection(canny_config);
+    auto hough_transform = createHoughTransform(hough_config, hough_type);
+    VideoPipelineConfig pipeline_config = loadPipelineConfig(config["pipeline"]);
+    pipeline_config.pyramid = pyramid;
+    std::unique_ptr<ParticleFilter> lane_tracker;
+    if (config["tracker"] && config["tracker"]["enabled"].as<bool>(false)) {
+        ParticleFilterConfig tracker_config = loadTrackerConfig(config["tracker"]);
+        tracker_config.roi = roi;
+        lane_tracker = createParticleFilter(tracker_config);
+    }
+    VideoPipeline pipeline(pipeline_config, std::move(video_service), std::move(canny_edge_detector),
+                           std::move(hough_transform), std::move(lane_tracker));
     pipeline.run(video_path);
+    dumpMetrics(config);
     return 0;
-}
\ No newline at end of file
+}
@@ -1,9 +1,409 @@
 #include "particle_filter.h"
+#include "instrumentation.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
 
+#if defined(__x86_64__)
+#define PARTICLE_FILTER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Particles per chunk. Every chunk draws its noise from its own stream, seeded from the
+// frame and chunk number, which keeps the result independent of the thread count.
+constexpr int kChunk = 256;
+
+// Adds row[x] to the score of every particle, where x = top + (bottom - top) * t is the
+// particle's boundary on this row. row holds width + 2 entries: index 0 and width + 1 are
+// padding that boundaries left and right of the frame land on.
+using ScoreRowFn = void (*)(const float* top, const float* bottom, int count, float t, const float* row, int width,
+                            float* scores);
+
+void scoreRowScalar(const float* top, const float* bottom, int count, float t, const float* row, int width,
+                    float* scores) {
+    const float limit = static_cast<float>(width + 1);
+    for (int i = 0; i < count; ++i) {
+        const float x = top[i] + (bottom[i] - top[i]) * t;
+        // One for the padding, a half to round
+        const float index = std::min(std::max(x + 1.5f, 0.0f), limit);
+        scores[i] += row[static_cast<int>(index)];
+    }
+}
+
+#ifdef PARTICLE_FILTER_X86
+
+// Same arithmetic in the same order as the scalar loop, so both give identical scores
+__attribute__((target("avx2")))
+void scoreRowAvx2(const float* top, const float* bottom, int count, float t, const float* row, int width,
+                  float* scores) {
+    const __m256 tv = _mm256_set1_ps(t);
+    const __m256 offset = _mm256_set1_ps(1.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 limit = _mm256_set1_ps(static_cast<float>(width + 1));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 a = _mm256_loadu_ps(top + i);
+        const __m256 b = _mm256_loadu_ps(bottom + i);
+        __m256 x = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), tv));
+        x = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(x, offset), zero), limit);
+        const __m256 score = _mm256_i32gather_ps(row, _mm256_cvttps_epi32(x), 4);
+        _mm256_storeu_ps(scores + i, _mm256_add_ps(_mm256_loadu_ps(scores + i), score));
+    }
+    scoreRowScalar(top + i, bottom + i, count - i, t, row, width, scores + i);
+}
+
+#endif
+
+ScoreRowFn selectScoreRowKernel() {
+#ifdef PARTICLE_FILTER_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return scoreRowAvx2;
+    }
+#endif
+    return scoreRowScalar;
+}
+
+}
+
+// Each particle is a pair of straight lane boundaries, stored as their x on the first and
+// last ROI row. It is scored by how close its boundaries pass to edge pixels on a fixed
+// set of sample rows; the closeness of every x on those rows is worked out once per frame,
+// so scoring a particle is a lookup per row and boundary.
 struct particle_filter_impl : public ParticleFilter {
-    TrackedState run(const Frame& frame) override {
-        // Implement particle filter algorithm
-        TrackedState state;
-        return state;
+    struct Particles {
+        std::vector<float> left_top;
+        std::vector<float> left_bottom;
+        std::vector<float> right_top;
+        std::vector<float> right_bottom;
+
+        void resize(size_t n) {
+            left_top.resize(n);
+            left_bottom.resize(n);
+            right_top.resize(n);
+            right_bottom.resize(n);
+        }
+    };
+
+    ParticleFilterConfig config_;
+    ScoreRowFn score_row_;
+    std::unique_ptr<ThreadPool> pool_;
+    size_t count_;
+    int chunks_;
+
+    // Frame geometry, rebuilt on a size change
+    int width_ = 0;
+    int height_ = 0;
+    float y_top_ = 0.0f;
+    float y_bottom_ = 0.0f;
+    // Where each sample row lies between the top (0) and bottom (1) ROI rows
+    std::vector<float> sample_t_;
+    // Sample index of every frame row, -1 for rows that are not sampled
+    std::vector<int> row_sample_;
+    // Edge pixels on the sample rows, then the score of every x on them (padded)
+    std::vector<uint8_t> marks_;
+    std::vector<uint8_t> distances_;
+    std::vector<float> score_rows_;
+    // Sample score by distance to the nearest edge, the last entry is 0
+    std::vector<float> distance_score_;
+
+    Particles particles_;
+    Particles resampled_;
+    // Per boundary, the score of every particle and its running weight total
+    std::vector<float> left_scores_;
+    std::vector<float> right_scores_;
+    std::vector<double> left_cumulative_;
+    std::vector<double> right_cumulative_;
+    std::minstd_rand rng_;
+    unsigned frame_ = 0;
+    // Random walk scale of each boundary for the next frame, see weigh()
+    float left_roughening_ = 1.0f;
+    float right_roughening_ = 1.0f;
+
+    bool seeded_ = false;
+    int good_frames_ = 0;
+    int frames_since_search_ = 0;
+    TrackedState state_;
+
+    explicit particle_filter_impl(const ParticleFilterConfig& config)
+        : config_(config), score_row_(selectScoreRowKernel()), rng_(12345) {
+        count_ = static_cast<size_t>(std::max(1, config_.particles));
+        chunks_ = static_cast<int>((count_ + kChunk - 1) / kChunk);
+        if (config_.threads > 1) {
+            pool_ = std::make_unique<ThreadPool>(config_.threads);
+        }
+        particles_.resize(count_);
+        resampled_.resize(count_);
+        left_scores_.resize(count_);
+        right_scores_.resize(count_);
+        left_cumulative_.resize(count_);
+        right_cumulative_.resize(count_);
+
+        const int max_distance = std::clamp(config_.max_distance, 1, 255);
+        const double sigma = std::max(0.1, config_.distance_sigma);
+        distance_score_.resize(max_distance + 1);
+        for (int d = 0; d <= max_distance; ++d) {
+            distance_score_[d] = d == max_distance ? 0.0f : static_cast<float>(std::exp(-d * d / (2.0 * sigma * sigma)));
+        }
+    }
+
+    void configure(int width, int height) {
+        if (width == width_ && height == height_) return;
+        width_ = width;
+        height_ = height;
+        const RoiSpans roi = compileRoi(config_.roi, width, height);
+        y_top_ = static_cast<float>(roi.y_begin);
+        y_bottom_ = static_cast<float>(roi.y_end - 1);
+
+        const int rows = roi.y_end - roi.y_begin;
+        const int samples = rows < 2 ? 0 : std::clamp(config_.sample_rows, 2, rows);
+        sample_t_.resize(samples);
+        row_sample_.assign(height, -1);
+        for (int s = 0; s < samples; ++s) {
+            const int y = roi.y_begin + static_cast<int>(std::lround(static_cast<double>(s) * (rows - 1) / (samples - 1)));
+            sample_t_[s] = (y - y_top_) / (y_bottom_ - y_top_);
+            row_sample_[y] = s;
+        }
+        marks_.assign(static_cast<size_t>(samples) * width, 0);
+        distances_.assign(width, 0);
+        score_rows_.assign(static_cast<size_t>(samples) * (width + 2), 0.0f);
+
+        // Particles from another frame size mean nothing here
+        seeded_ = false;
+        good_frames_ = 0;
+        state_ = TrackedState{};
+    }
+
+    bool seed(const std::vector<HoughLine>& lines, int width, int height) override {
+        configure(width, height);
+        if (sample_t_.empty()) return false;
+
+        const HoughLine* left = nullptr;
+        const HoughLine* right = nullptr;
+        float left_top = 0, left_bottom = 0, right_top = 0, right_bottom = 0;
+        for (const auto& line : lines) {
+            const double c = std::cos(line.theta), s = std::sin(line.theta);
+            // Near-horizontal lines are no lane boundaries
+            if (std::fabs(c) < 0.1) continue;
+            const float top = static_cast<float>((line.rho - y_top_ * s) / c);
+            const float bottom = static_cast<float>((line.rho - y_bottom_ * s) / c);
+            // Boundaries lean in towards the vanishing point: the left one runs to the right
+            // going up the image, the right one to the left
+            if (bottom < top) {
+                if (!left || line.votes > left->votes) {
+                    left = &line;
+                    left_top = top;
+                    left_bottom = bottom;
+                }
+            } else if (bottom > top) {
+                if (!right || line.votes > right->votes) {
+                    right = &line;
+                    right_top = top;
+                    right_bottom = bottom;
+                }
+            }
+        }
+        if (!left || !right) return false;
+
+        // A filter that still follows its lanes only gets an eighth of its particles moved,
+        // resampling then keeps whichever hypothesis fits the edges better
+        const bool full = !seeded_ || state_.confidence < config_.unlock_confidence;
+        const size_t begin = full ? 0 : count_ - count_ / 8;
+        std::normal_distribution<float> normal;
+        const float top_spread = static_cast<float>(config_.seed_top_spread);
+        const float bottom_spread = static_cast<float>(config_.seed_bottom_spread);
+        for (size_t i = begin; i < count_; ++i) {
+            particles_.left_top[i] = left_top + top_spread * normal(rng_);
+            particles_.left_bottom[i] = left_bottom + bottom_spread * normal(rng_);
+            particles_.right_top[i] = right_top + top_spread * normal(rng_);
+            particles_.right_bottom[i] = right_bottom + bottom_spread * normal(rng_);
+        }
+        if (full) {
+            seeded_ = true;
+            good_frames_ = 0;
+            state_ = TrackedState{};
+            left_roughening_ = 1.0f;
+            right_roughening_ = 1.0f;
+        }
+        frames_since_search_ = 0;
+        return true;
+    }
+
+    const TrackedState& run(const Edges& edges) override {
+        configure(edges.width, edges.height);
+        if (!seeded_) return state_;
+        CLT_SCOPED_TIMER(LaneTracking);
+
+        buildScoreRows(edges);
+        ++frame_;
+        const int tasks = pool_ ? std::min(pool_->size(), chunks_) : 1;
+        auto work = [&](int task) {
+            for (int chunk = chunks_ * task / tasks; chunk < chunks_ * (task + 1) / tasks; ++chunk) {
+                predictAndScore(chunk);
+            }
+        };
+        if (pool_ && tasks > 1) {
+            pool_->parallelFor(tasks, work);
+        } else {
+            work(0);
+        }
+
+        estimate();
+        resample();
+        return state_;
+    }
+
+    // Horizontal distance from every x of a sample row to the nearest edge pixel on it,
+    // capped at max_distance, two passes per row, then turned into a score
+    void buildScoreRows(const Edges& edges) {
+        std::fill(marks_.begin(), marks_.end(), 0);
+        for (size_t i = 0; i < edges.size(); ++i) {
+            const int s = row_sample_[edges.ys[i]];
+            if (s >= 0) marks_[static_cast<size_t>(s) * width_ + edges.xs[i]] = 1;
+        }
+        const int max_distance = static_cast<int>(distance_score_.size()) - 1;
+        for (size_t s = 0; s < sample_t_.size(); ++s) {
+            const uint8_t* marks = marks_.data() + s * width_;
+            float* scores = score_rows_.data() + s * (width_ + 2);
+            int d = max_distance;
+            for (int x = 0; x < width_; ++x) {
+                d = marks[x] ? 0 : std::min(d + 1, max_distance);
+                distances_[x] = static_cast<uint8_t>(d);
+            }
+            d = max_distance;
+            for (int x = width_ - 1; x >= 0; --x) {
+                d = marks[x] ? 0 : std::min(d + 1, max_distance);
+                scores[x + 1] = distance_score_[std::min<int>(d, distances_[x])];
+            }
+            scores[0] = 0.0f;
+            scores[width_ + 1] = 0.0f;
+        }
+    }
+
+    void predictAndScore(int chunk) {
+        const size_t begin = static_cast<size_t>(chunk) * kChunk;
+        const int count = static_cast<int>(std::min<size_t>(kChunk, count_ - begin));
+        float* left_top = particles_.left_top.data() + begin;
+        float* left_bottom = particles_.left_bottom.data() + begin;
+        float* right_top = particles_.right_top.data() + begin;
+        float* right_bottom = particles_.right_bottom.data() + begin;
+
+        std::minstd_rand rng(frame_ * 7919u + static_cast<unsigned>(chunk) + 1u);
+        std::normal_distribution<float> normal;
+        const float top_noise = static_cast<float>(config_.top_noise);
+        const float bottom_noise = static_cast<float>(config_.bottom_noise);
+        const float left_top_noise = top_noise * left_roughening_, left_bottom_noise = bottom_noise * left_roughening_;
+        const float right_top_noise = top_noise * right_roughening_, right_bottom_noise = bottom_noise * right_roughening_;
+        for (int i = 0; i < count; ++i) {
+            left_top[i] += left_top_noise * normal(rng);
+            left_bottom[i] += left_bottom_noise * normal(rng);
+            right_top[i] += right_top_noise * normal(rng);
+            right_bottom[i] += right_bottom_noise * normal(rng);
+        }
+
+        float* left_scores = left_scores_.data() + begin;
+        float* right_scores = right_scores_.data() + begin;
+        std::fill(left_scores, left_scores + count, 0.0f);
+        std::fill(right_scores, right_scores + count, 0.0f);
+        for (size_t s = 0; s < sample_t_.size(); ++s) {
+            const float* row = score_rows_.data() + s * (width_ + 2);
+            score_row_(left_top, left_bottom, count, sample_t_[s], row, width_, left_scores);
+            score_row_(right_top, right_bottom, count, sample_t_[s], row, width_, right_scores);
+        }
+    }
+
+    // Weighted mean of the particles, scored like a particle for the confidence. A
+    // particle's weight is the product of one factor per boundary, so each boundary is
+    // weighed and resampled on its own score: otherwise the particles that fit a solid
+    // marking best would decide which hypotheses of the other boundary survive.
+    void estimate() {
+        const double samples = 2.0 * sample_t_.size();
+        const double sharpness = config_.sharpness / samples;
+        float mean[4];
+        left_roughening_ = weigh(left_scores_, left_cumulative_, sharpness, particles_.left_top, particles_.left_bottom,
+                                 mean[0], mean[1]);
+        right_roughening_ = weigh(right_scores_, right_cumulative_, sharpness, particles_.right_top,
+                                  particles_.right_bottom, mean[2], mean[3]);
+
+        float score = 0.0f;
+        for (size_t s = 0; s < sample_t_.size(); ++s) {
+            const float* row = score_rows_.data() + s * (width_ + 2);
+            scoreRowScalar(&mean[0], &mean[1], 1, sample_t_[s], row, width_, &score);
+            scoreRowScalar(&mean[2], &mean[3], 1, sample_t_[s], row, width_, &score);
+        }
+        const float confidence = static_cast<float>(score / samples);
+
+        good_frames_ = confidence >= config_.lock_confidence ? good_frames_ + 1 : 0;
+        state_.locked = state_.locked ? confidence >= config_.unlock_confidence : good_frames_ >= config_.lock_frames;
+        if (state_.locked) ++frames_since_search_;
+        state_.confidence = confidence;
+        state_.left = boundaryLine(mean[0], mean[1], confidence);
+        state_.right = boundaryLine(mean[2], mean[3], confidence);
+    }
+
+    // Running weight totals of one boundary and its weighted mean. Returns the scale of its
+    // next random walk: when the weights collapse onto a few particles, the boundary has
+    // likely moved further than the walk reaches, so the next one is widened.
+    float weigh(const std::vector<float>& scores, std::vector<double>& cumulative, double sharpness,
+                const std::vector<float>& top, const std::vector<float>& bottom, float& mean_top, float& mean_bottom) {
+        const float best = *std::max_element(scores.begin(), scores.end());
+        double total = 0.0, squares = 0.0, sum_top = 0.0, sum_bottom = 0.0;
+        for (size_t i = 0; i < count_; ++i) {
+            const double weight = std::exp(sharpness * (scores[i] - best));
+            total += weight;
+            squares += weight * weight;
+            cumulative[i] = total;
+            sum_top += weight * top[i];
+            sum_bottom += weight * bottom[i];
+        }
+        mean_top = static_cast<float>(sum_top / total);
+        mean_bottom = static_cast<float>(sum_bottom / total);
+        // Effective sample size, how many particles the weights really rest on
+        const double ess = total * total / squares;
+        return static_cast<float>(1.0 + config_.roughening / std::sqrt(ess));
+    }
+
+    void resample() {
+        resampleBoundary(left_cumulative_, particles_.left_top, particles_.left_bottom, resampled_.left_top,
+                         resampled_.left_bottom);
+        resampleBoundary(right_cumulative_, particles_.right_top, particles_.right_bottom, resampled_.right_top,
+                         resampled_.right_bottom);
+        std::swap(particles_, resampled_);
+    }
+
+    // Systematic resampling: one random offset, then n evenly spaced picks along the
+    // cumulative weights
+    void resampleBoundary(const std::vector<double>& cumulative, const std::vector<float>& top,
+                          const std::vector<float>& bottom, std::vector<float>& out_top, std::vector<float>& out_bottom) {
+        const double step = cumulative.back() / static_cast<double>(count_);
+        std::uniform_real_distribution<double> start(0.0, step);
+        double u = start(rng_);
+        size_t i = 0;
+        for (size_t j = 0; j < count_; ++j, u += step) {
+            while (i + 1 < count_ && cumulative[i] < u) ++i;
+            out_top[j] = top[i];
+            out_bottom[j] = bottom[i];
+        }
+    }
+
+    // Hough form of the boundary through (x_top, y_top_) and (x_bottom, y_bottom_)
+    HoughLine boundaryLine(float x_top, float x_bottom, float votes) const {
+        const double theta = std::atan2(static_cast<double>(x_top) - x_bottom, static_cast<double>(y_bottom_) - y_top_);
+        return HoughLine{votes, x_top * std::cos(theta) + y_top_ * std::sin(theta), theta};
+    }
+
+    const TrackedState& getState() const override {
+        return state_;
+    }
+
+    bool needsFullSearch() const override {
+        return !state_.locked ||
+               (config_.full_search_interval > 0 && frames_since_search_ >= config_.full_search_interval);
     }
 };
+
+std::unique_ptr<ParticleFilter> createParticleFilter(const ParticleFilterConfig& config) {
+    return std::make_unique<particle_filter_impl>(config);
+}
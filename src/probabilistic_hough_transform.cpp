@@ -0,0 +1,230 @@
+#include "hough_transform.h"
+#include "hough_accumulator.h"
+#include "instrumentation.h"
+#include <random>
+
+// Progressive probabilistic Hough transform (Matas, Galambos, Kittler). Edge pixels vote
+// one at a time in random order. As soon as a pixel pushes a bin over lineThreshold, the
+// line through it is followed over the edge map, its pixels are taken out (and their votes
+// withdrawn), and voting continues. The cost tracks the number of lines found rather than
+// the number of edge pixels.
+struct probabilistic_hough_transform_impl : public HoughTransform {
+    // Edge map states. Everything is back to kEmpty between frames.
+    static constexpr uint8_t kEmpty = 0;
+    static constexpr uint8_t kPending = 1; // edge pixel that has not voted yet
+    static constexpr uint8_t kVoted = 2;   // edge pixel whose votes are in the accumulator
+    static constexpr uint8_t kRetired = 3; // taken out by a too-short segment, votes still counted
+
+    HoughTransformConfig config_;
+    HoughAccumulator accumulator;
+    RoiSpans roi_;
+    Frame mask_{0,0};
+
+    Edges frame_edges_;
+    Edges roi_edges_;
+    std::vector<uint32_t> order_;
+    std::minstd_rand rng_;
+
+    std::vector<HoughLine> top;
+    std::vector<HoughSegment> segments_;
+    HoughStats stats_;
+
+    explicit probabilistic_hough_transform_impl(const HoughTransformConfig& config) : config_(config) {
+        top.reserve(std::max(0, config_.numberOfLines));
+        segments_.reserve(std::max(0, config_.numberOfLines));
+    }
+
+    void ensureBuffers(int w, int h) {
+        if (mask_.width != w || mask_.height != h) {
+            mask_ = Frame(w, h);
+            roi_ = compileRoi(config_.roi, w, h);
+        }
+        // The accumulator is left zeroed at the end of every frame, so it never needs a clear
+        accumulator.configure(config_, w, h, roi_.y_begin);
+    }
+
+    void run(const FrameView& edges) override {
+        ensureBuffers(edges.width, edges.height);
+        collectEdges(edges, roi_, frame_edges_);
+        run(frame_edges_);
+    }
+
+    void run(const Edges& all_edges) override {
+        // Voting and line extraction interleave here, so both count as voting
+        CLT_SCOPED_TIMER(HoughVoting);
+        ensureBuffers(all_edges.width, all_edges.height);
+        const Edges& edges = edgesInRoi(all_edges, roi_, roi_edges_);
+        stats_ = HoughStats{};
+        top.clear();
+        segments_.clear();
+
+        // Same seed every frame, so a given edge list always gives the same segments
+        rng_.seed(12345);
+        order_.clear();
+        for (size_t i = 0; i < edges.size(); ++i) {
+            mask_.at(edges.xs[i], edges.ys[i]) = kPending;
+            order_.push_back(static_cast<uint32_t>(i));
+        }
+        stats_.edge_pixels = order_.size();
+
+        const size_t max_lines = static_cast<size_t>(std::max(0, config_.numberOfLines));
+        for (size_t n = 0; n < order_.size() && segments_.size() < max_lines; ++n) {
+            // Incremental Fisher-Yates, only shuffles as far as we actually get
+            std::uniform_int_distribution<size_t> pick(n, order_.size() - 1);
+            std::swap(order_[n], order_[pick(rng_)]);
+            const int x = edges.xs[order_[n]];
+            const int y = edges.ys[order_[n]];
+            if (mask_.at(x, y) != kPending) continue;
+
+            mask_.at(x, y) = kVoted;
+            size_t best_t = 0;
+            int32_t best_r = 0;
+            int best_votes = 0;
+            voteAndFindMax(x, y, best_t, best_r, best_votes);
+            if (best_votes < config_.lineThreshold) continue;
+
+            extractSegment(x, y, best_t, best_r, best_votes);
+        }
+
+        // Withdraw whatever is still in the accumulator and empty the edge map
+        for (uint32_t i : order_) {
+            const int x = edges.xs[i];
+            const int y = edges.ys[i];
+            const uint8_t state = mask_.at(x, y);
+            if (state == kVoted || state == kRetired) unvote(x, y);
+            mask_.at(x, y) = kEmpty;
+        }
+        CLT_RECORD(VotesCast, stats_.votes_cast);
+        CLT_RECORD(PeaksFound, segments_.size());
+    }
+
+    static bool isEdge(uint8_t state) {
+        return state == kPending || state == kVoted;
+    }
+
+    void voteAndFindMax(int x, int y, size_t& best_t, int32_t& best_r, int& best_votes) {
+        HoughAccumulator::Count* cell = accumulator.votes.data();
+        for (size_t t = 0; t < accumulator.theta_bins; ++t, cell += accumulator.rho_bins) {
+            int32_t r = accumulator.rhoIndex(t, x, y);
+            if (static_cast<size_t>(r) >= accumulator.rho_bins) continue;
+            int votes = ++cell[r];
+            if (votes > best_votes) {
+                best_votes = votes;
+                best_t = t;
+                best_r = r;
+            }
+        }
+        stats_.votes_cast += accumulator.theta_bins;
+    }
+
+    void unvote(int x, int y) {
+        HoughAccumulator::Count* cell = accumulator.votes.data();
+        for (size_t t = 0; t < accumulator.theta_bins; ++t, cell += accumulator.rho_bins) {
+            int32_t r = accumulator.rhoIndex(t, x, y);
+            if (static_cast<size_t>(r) < accumulator.rho_bins) --cell[r];
+        }
+    }
+
+    // Walks the line (best_r, best_t) both ways from (x, y) over the edge map, bridging gaps
+    // up to maxLineGap. The walked pixels are removed; if the segment is long enough it is
+    // reported and the votes of its pixels are withdrawn.
+    void extractSegment(int x, int y, size_t t, int32_t r, int votes) {
+        const int shift = 16;
+        const double theta = accumulator.thetas_rad[t];
+        // Direction along the line, perpendicular to its normal (cos, sin)
+        const double a = -std::sin(theta);
+        const double b = std::cos(theta);
+
+        // Step one pixel along the major axis and a fixed-point fraction along the other
+        const bool x_major = std::fabs(a) > std::fabs(b);
+        int x0, y0, dx0, dy0;
+        if (x_major) {
+            dx0 = a > 0 ? 1 : -1;
+            dy0 = static_cast<int>(std::lround(b * (1 << shift) / std::fabs(a)));
+            x0 = x;
+            y0 = (y << shift) + (1 << (shift - 1));
+        } else {
+            dy0 = b > 0 ? 1 : -1;
+            dx0 = static_cast<int>(std::lround(a * (1 << shift) / std::fabs(b)));
+            x0 = (x << shift) + (1 << (shift - 1));
+            y0 = y;
+        }
+        auto pixel = [&](int px, int py, int& out_x, int& out_y) {
+            out_x = x_major ? px : px >> shift;
+            out_y = x_major ? py >> shift : py;
+        };
+        auto inside = [&](int px, int py) { return roi_.contains(px, py); };
+
+        int end_x[2] = {x, x}, end_y[2] = {y, y};
+        for (int k = 0; k < 2; ++k) {
+            int gap = 0;
+            int px = x0, py = y0;
+            const int dx = k == 0 ? dx0 : -dx0;
+            const int dy = k == 0 ? dy0 : -dy0;
+            for (;; px += dx, py += dy) {
+                int ix, iy;
+                pixel(px, py, ix, iy);
+                if (!inside(ix, iy)) break;
+                if (isEdge(mask_.at(ix, iy))) {
+                    gap = 0;
+                    end_x[k] = ix;
+                    end_y[k] = iy;
+                } else if (++gap > config_.maxLineGap) {
+                    break;
+                }
+            }
+        }
+
+        const bool good_line = std::abs(end_x[1] - end_x[0]) >= config_.minLineLength ||
+                               std::abs(end_y[1] - end_y[0]) >= config_.minLineLength;
+
+        // Second walk over the same pixels, up to the endpoints found above
+        for (int k = 0; k < 2; ++k) {
+            int px = x0, py = y0;
+            const int dx = k == 0 ? dx0 : -dx0;
+            const int dy = k == 0 ? dy0 : -dy0;
+            for (;; px += dx, py += dy) {
+                int ix, iy;
+                pixel(px, py, ix, iy);
+                if (!inside(ix, iy)) break;
+                uint8_t& state = mask_.at(ix, iy);
+                if (isEdge(state)) {
+                    if (good_line) {
+                        if (state == kVoted) unvote(ix, iy);
+                        state = kEmpty;
+                    } else {
+                        // Short segments keep their votes, like the reference algorithm
+                        state = state == kVoted ? kRetired : kEmpty;
+                    }
+                }
+                if (ix == end_x[k] && iy == end_y[k]) break;
+            }
+        }
+
+        if (good_line) {
+            const double rho = accumulator.rho(static_cast<size_t>(r));
+            segments_.push_back(HoughSegment{end_x[0], end_y[0], end_x[1], end_y[1], static_cast<float>(votes), rho, theta});
+            top.push_back(HoughLine{static_cast<float>(votes), rho, theta});
+        }
+    }
+
+    const std::vector<HoughLine>& getDetectedLines() const override {
+        return top;
+    }
+
+    const std::vector<HoughSegment>& getDetectedSegments() const override {
+        return segments_;
+    }
+
+    const HoughStats& getStats() const override {
+        return stats_;
+    }
+
+    const RoiSpans& getRoi() const override {
+        return roi_;
+    }
+};
+
+std::unique_ptr<HoughTransform> createProgressiveHoughTransform(const HoughTransformConfig& config) {
+    return std::make_unique<probabilistic_hough_transform_impl>(config);
+}
@@ -0,0 +1,208 @@
+#include "pyramid.h"
+#include "hough_transform.h"
+#include <algorithm>
+#include <cmath>
+
+void downscaleFrame(const FrameView& src, FrameView dst, int factor) {
+    if (factor == 2) {
+        for (int y = 0; y < dst.height; ++y) {
+            const uint8_t* r0 = src.row(2 * y);
+            const uint8_t* r1 = src.row(2 * y + 1);
+            uint8_t* out = dst.row(y);
+            for (int x = 0; x < dst.width; ++x) {
+                out[x] = static_cast<uint8_t>((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2);
+            }
+        }
+        return;
+    }
+    const int area = factor * factor;
+    for (int y = 0; y < dst.height; ++y) {
+        uint8_t* out = dst.row(y);
+        for (int x = 0; x < dst.width; ++x) {
+            int sum = 0;
+            for (int dy = 0; dy < factor; ++dy) {
+                const uint8_t* row = src.row(y * factor + dy) + x * factor;
+                for (int dx = 0; dx < factor; ++dx) sum += row[dx];
+            }
+            out[x] = static_cast<uint8_t>((sum + area / 2) / area);
+        }
+    }
+}
+
+// Pixel x of the small frame averages full-resolution columns [x * f, x * f + f), whose
+// centre is x * f + (f - 1) / 2. The same holds for rows.
+HoughLine upscaleLine(const HoughLine& line, int factor) {
+    const double offset = 0.5 * (factor - 1);
+    HoughLine out = line;
+    out.rho = line.rho * factor + offset * (std::cos(line.theta) + std::sin(line.theta));
+    return out;
+}
+
+HoughSegment upscaleSegment(const HoughSegment& segment, int factor) {
+    const int offset = (factor - 1) / 2;
+    HoughSegment out = segment;
+    out.x0 = segment.x0 * factor + offset;
+    out.y0 = segment.y0 * factor + offset;
+    out.x1 = segment.x1 * factor + offset;
+    out.y1 = segment.y1 * factor + offset;
+    const HoughLine line = upscaleLine(HoughLine{segment.votes, segment.rho, segment.theta}, factor);
+    out.rho = line.rho;
+    return out;
+}
+
+LineRefiner::LineRefiner(const PyramidConfig& config) : config_(config) {}
+
+void LineRefiner::refine(const FrameView& gray, const RoiSpans& coarse_roi, std::vector<HoughLine>& lines,
+                         std::vector<HoughSegment>& segments) {
+    const int factor = std::max(1, config_.factor);
+    if (roi_.width != gray.width || roi_.height != gray.height) {
+        roi_ = coarse_roi.upscaled(factor, gray.width, gray.height);
+    }
+    const bool with_segments = !segments.empty() && segments.size() == lines.size();
+    for (size_t i = 0; i < lines.size(); ++i) {
+        HoughLine& line = lines[i];
+        line = upscaleLine(line, factor);
+        int x0, y0, x1, y1;
+        if (with_segments) {
+            segments[i] = upscaleSegment(segments[i], factor);
+            x0 = segments[i].x0;
+            y0 = segments[i].y0;
+            x1 = segments[i].x1;
+            y1 = segments[i].y1;
+        } else {
+            lineEndpoints(line, gray.width, gray.height, x0, y0, x1, y1);
+            cv::Point p0(x0, y0), p1(x1, y1);
+            if (!cv::clipLine(cv::Size(gray.width, gray.height), p0, p1)) continue;
+            x0 = p0.x;
+            y0 = p0.y;
+            x1 = p1.x;
+            y1 = p1.y;
+            if (!clipToRoi(roi_, x0, y0, x1, y1)) continue;
+        }
+
+        // A wide search first, then a narrow one around the first fit
+        if (!fit(gray, line, x0, y0, x1, y1, config_.refine_radius)) continue;
+        fit(gray, line, x0, y0, x1, y1, std::max(2, config_.refine_radius / 2));
+
+        if (with_segments) {
+            // Endpoints move onto the refitted line
+            HoughSegment& segment = segments[i];
+            const double c = std::cos(line.theta), s = std::sin(line.theta);
+            auto project = [&](int& x, int& y) {
+                const double d = x * c + y * s - line.rho;
+                x = static_cast<int>(std::lround(x - d * c));
+                y = static_cast<int>(std::lround(y - d * s));
+            };
+            project(segment.x0, segment.y0);
+            project(segment.x1, segment.y1);
+            segment.rho = line.rho;
+            segment.theta = line.theta;
+        }
+    }
+}
+
+bool LineRefiner::fit(const FrameView& gray, HoughLine& line, double x0, double y0, double x1, double y1, int radius) {
+    const double nx = std::cos(line.theta), ny = std::sin(line.theta);
+    // Project the endpoints onto the current line, so sampling follows it exactly
+    auto project = [&](double& x, double& y) {
+        const double d = x * nx + y * ny - line.rho;
+        x -= d * nx;
+        y -= d * ny;
+    };
+    project(x0, y0);
+    project(x1, y1);
+
+    xs_.clear();
+    ys_.clear();
+    signs_.clear();
+    const int samples = static_cast<int>(std::max(std::fabs(x1 - x0), std::fabs(y1 - y0)));
+    int positive = 0, negative = 0;
+    for (int i = 0; i <= samples; ++i) {
+        const double t = samples > 0 ? static_cast<double>(i) / samples : 0.0;
+        const double px = x0 + t * (x1 - x0), py = y0 + t * (y1 - y0);
+        // Grey levels across the line at offsets -radius - 1 .. radius + 1
+        auto level = [&](int k, int& value) {
+            const int x = static_cast<int>(std::lround(px + k * nx));
+            const int y = static_cast<int>(std::lround(py + k * ny));
+            if (x < 0 || x >= gray.width || y < 0 || y >= gray.height) return false;
+            value = gray.at(x, y);
+            return true;
+        };
+        int best_k = 0, best_step = 0;
+        int previous, current, next;
+        if (!level(-radius - 1, previous) || !level(-radius, current)) continue;
+        bool inside = true;
+        int around[3] = {0, 0, 0}; // steps at best_k - 1, best_k, best_k + 1
+        int last_step = 0;
+        for (int k = -radius; k <= radius; ++k) {
+            if (!level(k + 1, next)) {
+                inside = false;
+                break;
+            }
+            const int step = next - previous;
+            if (std::abs(step) > std::abs(best_step)) {
+                best_step = step;
+                best_k = k;
+                around[0] = last_step;
+                around[1] = step;
+                around[2] = 0;
+            } else if (k == best_k + 1) {
+                around[2] = step;
+            }
+            last_step = step;
+            previous = current;
+            current = next;
+        }
+        if (!inside || std::abs(best_step) < config_.refine_min_gradient) continue;
+
+        // Parabola through the step magnitudes around the peak, for a sub-pixel position
+        double offset = 0.0;
+        if (best_k > -radius && best_k < radius) {
+            const double a = std::abs(around[0]), b = std::abs(around[1]), c = std::abs(around[2]);
+            const double denominator = a - 2.0 * b + c;
+            if (denominator < 0.0) offset = std::clamp(0.5 * (a - c) / denominator, -0.5, 0.5);
+        }
+        xs_.push_back(static_cast<float>(px + (best_k + offset) * nx));
+        ys_.push_back(static_cast<float>(py + (best_k + offset) * ny));
+        signs_.push_back(best_step > 0 ? 1 : -1);
+        (best_step > 0 ? positive : negative) += std::abs(best_step);
+    }
+
+    // A marking has a rising and a falling edge, only fit the one the line found more of
+    const int polarity = positive >= negative ? 1 : -1;
+    double sum_x = 0.0, sum_y = 0.0;
+    size_t count = 0;
+    for (size_t i = 0; i < xs_.size(); ++i) {
+        if (signs_[i] != polarity) continue;
+        sum_x += xs_[i];
+        sum_y += ys_[i];
+        ++count;
+    }
+    if (count < static_cast<size_t>(std::max(2, config_.refine_min_points))) return false;
+    const double mx = sum_x / count, my = sum_y / count;
+    double sxx = 0.0, sxy = 0.0, syy = 0.0;
+    for (size_t i = 0; i < xs_.size(); ++i) {
+        if (signs_[i] != polarity) continue;
+        const double dx = xs_[i] - mx, dy = ys_[i] - my;
+        sxx += dx * dx;
+        sxy += dx * dy;
+        syy += dy * dy;
+    }
+
+    // The normal is perpendicular to the principal axis. Keep it on the same side as the
+    // coarse one, then fold it back into [-90, 90] degrees like the Hough thetas.
+    double theta = 0.5 * std::atan2(2.0 * sxy, sxx - syy) + 0.5 * CV_PI;
+    while (theta - line.theta > 0.5 * CV_PI) theta -= CV_PI;
+    while (theta - line.theta < -0.5 * CV_PI) theta += CV_PI;
+    double rho = mx * std::cos(theta) + my * std::sin(theta);
+    if (theta > 0.5 * CV_PI) {
+        theta -= CV_PI;
+        rho = -rho;
+    } else if (theta < -0.5 * CV_PI) {
+        theta += CV_PI;
+        rho = -rho;
+    }
+    line.theta = theta;
+    line.rho = rho;
+    return true;
+}
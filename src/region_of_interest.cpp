@@ -0,0 +1,146 @@
+#include "region_of_interest.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+RoiConfig RoiConfig::trapezoid(double top, double bottom, double top_width, double bottom_width, double center) {
+    RoiConfig roi;
+    roi.polygon = {{center - 0.5 * top_width, top},
+                   {center + 0.5 * top_width, top},
+                   {center + 0.5 * bottom_width, bottom},
+                   {center - 0.5 * bottom_width, bottom}};
+    return roi;
+}
+
+// Recomputes y_begin and y_end from the spans
+static void updateRowRange(RoiSpans& spans) {
+    spans.y_begin = spans.height;
+    spans.y_end = 0;
+    for (int y = 0; y < spans.height; ++y) {
+        if (spans.rows[y].empty()) {
+            spans.rows[y] = RowSpan{};
+            continue;
+        }
+        spans.y_begin = std::min(spans.y_begin, y);
+        spans.y_end = y + 1;
+    }
+    if (spans.y_begin >= spans.y_end) spans.y_begin = spans.y_end = 0;
+}
+
+RoiSpans compileRoi(const RoiConfig& roi, int width, int height) {
+    RoiSpans spans;
+    spans.width = width;
+    spans.height = height;
+    spans.rows.assign(std::max(0, height), RowSpan{});
+
+    if (roi.polygon.empty()) {
+        for (int y = height / 2; y < height; ++y) spans.rows[y] = RowSpan{0, width};
+        updateRowRange(spans);
+        return spans;
+    }
+
+    // A pixel is inside when its centre is. Each row takes the extreme crossings of its
+    // centre line with the polygon edges.
+    const size_t n = roi.polygon.size();
+    for (int y = 0; y < height; ++y) {
+        const double yc = y + 0.5;
+        double x_min = std::numeric_limits<double>::max();
+        double x_max = std::numeric_limits<double>::lowest();
+        for (size_t i = 0; i < n; ++i) {
+            const RoiPoint& p = roi.polygon[i];
+            const RoiPoint& q = roi.polygon[(i + 1) % n];
+            const double px = p.x * width, py = p.y * height;
+            const double qx = q.x * width, qy = q.y * height;
+            if (yc < std::min(py, qy) || yc > std::max(py, qy)) continue;
+            if (py == qy) {
+                x_min = std::min({x_min, px, qx});
+                x_max = std::max({x_max, px, qx});
+            } else {
+                const double x = px + (qx - px) * (yc - py) / (qy - py);
+                x_min = std::min(x_min, x);
+                x_max = std::max(x_max, x);
+            }
+        }
+        if (x_min > x_max) continue;
+        const int begin = std::max(0, static_cast<int>(std::ceil(x_min - 0.5)));
+        const int end = std::min(width, static_cast<int>(std::floor(x_max - 0.5)) + 1);
+        if (begin < end) spans.rows[y] = RowSpan{begin, end};
+    }
+    updateRowRange(spans);
+    return spans;
+}
+
+RoiSpans RoiSpans::dilated(int dx, int dy) const {
+    RoiSpans out;
+    out.width = width;
+    out.height = height;
+    out.rows.assign(rows.size(), RowSpan{});
+    for (int y = 0; y < height; ++y) {
+        RowSpan span{width, 0};
+        for (int k = std::max(y_begin, y - dy); k < std::min(y_end, y + dy + 1); ++k) {
+            if (rows[k].empty()) continue;
+            span.begin = std::min(span.begin, rows[k].begin - dx);
+            span.end = std::max(span.end, rows[k].end + dx);
+        }
+        out.rows[y] = RowSpan{std::max(0, span.begin), std::min(width, span.end)};
+    }
+    updateRowRange(out);
+    return out;
+}
+
+RoiSpans RoiSpans::clipped(int x_begin, int x_end, int y_begin, int y_end) const {
+    RoiSpans out = *this;
+    for (int y = 0; y < height; ++y) {
+        RowSpan& span = out.rows[y];
+        if (y < y_begin || y >= y_end) {
+            span = RowSpan{};
+        } else {
+            span.begin = std::max(span.begin, x_begin);
+            span.end = std::min(span.end, x_end);
+        }
+    }
+    updateRowRange(out);
+    return out;
+}
+
+RoiSpans RoiSpans::upscaled(int factor, int width, int height) const {
+    RoiSpans out;
+    out.width = width;
+    out.height = height;
+    out.rows.assign(std::max(0, height), RowSpan{});
+    for (int y = 0; y < height && this->height > 0; ++y) {
+        const RowSpan& span = rows[std::min(y / factor, this->height - 1)];
+        if (span.empty()) continue;
+        out.rows[y] = RowSpan{span.begin * factor, span.end >= this->width ? width : std::min(width, span.end * factor)};
+    }
+    updateRowRange(out);
+    return out;
+}
+
+bool clipToRoi(const RoiSpans& roi, int& x0, int& y0, int& x1, int& y1) {
+    // Walk the segment one pixel per step along its major axis
+    const int steps = std::max(std::abs(x1 - x0), std::abs(y1 - y0));
+    auto point = [&](int i, int& x, int& y) {
+        const double t = steps > 0 ? static_cast<double>(i) / steps : 0.0;
+        x = static_cast<int>(std::lround(x0 + t * (x1 - x0)));
+        y = static_cast<int>(std::lround(y0 + t * (y1 - y0)));
+    };
+    int first = -1, last = -1;
+    for (int i = 0; i <= steps; ++i) {
+        int x, y;
+        point(i, x, y);
+        if (!roi.contains(x, y)) continue;
+        if (first < 0) first = i;
+        last = i;
+    }
+    if (first < 0) return false;
+    int ax, ay, bx, by;
+    point(first, ax, ay);
+    point(last, bx, by);
+    x0 = ax;
+    y0 = ay;
+    x1 = bx;
+    y1 = by;
+    return true;
+}
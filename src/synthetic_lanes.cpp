@@ -0,0 +1,64 @@
+#include "synthetic_lanes.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+SyntheticMarking syntheticLaneMarking(const SyntheticLaneConfig& config, int frame_index, int side, int y) {
+    const int w = config.width;
+    const int h = config.height;
+    const double vanish_x = w * (0.5 + 0.08 * std::sin(frame_index * 0.05));
+    const double vanish_y = h / 2 - h * 0.05;
+    const double depth = (y - vanish_y) / (h - vanish_y);
+    return SyntheticMarking{vanish_x + side * w * 0.45 * depth, std::max(1.0, 0.012 * w * depth)};
+}
+
+Frame makeSyntheticLaneFrame(const SyntheticLaneConfig& config, int frame_index) {
+    const int w = config.width;
+    const int h = config.height;
+    Frame frame(w, h);
+    std::minstd_rand rng(config.seed * 7919u + static_cast<unsigned>(frame_index));
+    std::uniform_int_distribution<int> noise(-config.noise, config.noise);
+
+    const int horizon = h / 2;
+    for (int y = 0; y < h; ++y) {
+        uint8_t* row = frame.row(y);
+        // Bright sky fading to darker asphalt below the horizon
+        const int base = y < horizon ? 170 - 40 * y / std::max(1, horizon) : 80;
+        for (int x = 0; x < w; ++x) {
+            row[x] = static_cast<uint8_t>(std::clamp(base + noise(rng), 0, 255));
+        }
+    }
+
+    const double vanish_y = horizon - h * 0.05;
+    for (int y = horizon; y < h; ++y) {
+        const double depth = (y - vanish_y) / (h - vanish_y);
+        // Dashed right marking, 12 dashes from horizon to bottom
+        const bool dash_on = static_cast<int>(depth * 24.0 + frame_index * 0.3) % 2 == 0;
+        for (int side = -1; side <= 1; side += 2) {
+            if (side > 0 && !dash_on) continue;
+            const SyntheticMarking marking = syntheticLaneMarking(config, frame_index, side, y);
+            const int x0 = std::max(0, static_cast<int>(marking.center - marking.half_width));
+            const int x1 = std::min(w - 1, static_cast<int>(marking.center + marking.half_width));
+            uint8_t* row = frame.row(y);
+            for (int x = x0; x <= x1; ++x) {
+                row[x] = static_cast<uint8_t>(std::clamp(220 + noise(rng) / 2, 0, 255));
+            }
+        }
+    }
+
+    std::uniform_int_distribution<int> patch_x(0, std::max(0, w - 1));
+    std::uniform_int_distribution<int> patch_y(horizon, std::max(horizon, h - 1));
+    std::uniform_int_distribution<int> patch_size(4, std::max(5, w / 40));
+    for (int i = 0; i < config.clutter; ++i) {
+        const int px = patch_x(rng), py = patch_y(rng);
+        const int size = patch_size(rng);
+        const uint8_t level = static_cast<uint8_t>(130 + (i * 37) % 100);
+        for (int y = py; y < std::min(h, py + size / 2); ++y) {
+            uint8_t* row = frame.row(y);
+            for (int x = px; x < std::min(w, px + size); ++x) {
+                row[x] = level;
+            }
+        }
+    }
+    return frame;
+}
@@ -0,0 +1,69 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads) {
+    for (int i = 1; i < std::max(1, threads); ++i) {
+        workers_.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(int tasks, TaskFn fn, void* context) {
+    if (tasks <= 0) return;
+    if (workers_.empty() || tasks == 1) {
+        for (int i = 0; i < tasks; ++i) fn(context, i);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fn_ = fn;
+        context_ = context;
+        tasks_ = tasks;
+        next_.store(0, std::memory_order_relaxed);
+        finished_.store(0, std::memory_order_relaxed);
+        active_workers_ = static_cast<int>(workers_.size());
+        ++generation_;
+    }
+    wake_.notify_all();
+    drain();
+
+    // Wait for the tasks and for every worker to leave the job, so the next
+    // run() can't reset counters under a worker that is still draining
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return finished_.load(std::memory_order_acquire) == tasks_ && active_workers_ == 0; });
+}
+
+void ThreadPool::drain() {
+    for (int i = next_.fetch_add(1, std::memory_order_relaxed); i < tasks_; i = next_.fetch_add(1, std::memory_order_relaxed)) {
+        fn_(context_, i);
+        finished_.fetch_add(1, std::memory_order_acq_rel);
+    }
+}
+
+void ThreadPool::workerLoop() {
+    unsigned seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_) return;
+            seen = generation_;
+        }
+        drain();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --active_workers_;
+        }
+        done_.notify_one();
+    }
+}
@@ -0,0 +1,297 @@
+#include "video_pipeline.h"
+#include "instrumentation.h"
+#include <iostream>
+#include <limits>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Passed down the queues after the last frame, each stage forwards it and exits
+constexpr std::uint32_t kEndOfStream = std::numeric_limits<std::uint32_t>::max();
+
+const char* const kStageNames[] = {"decode", "canny", "hough", "render"};
+
+std::uint64_t nanosecondsSince(Clock::time_point start) {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+}
+
+// Spins briefly, then sleeps, so an idle stage does not burn a core
+void backoff(int& spins) {
+    if (++spins < 64) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+void pushWaiting(SpscRing<std::uint32_t>& queue, std::uint32_t slot) {
+    int spins = 0;
+    while (!queue.push(slot)) backoff(spins);
+}
+
+std::uint32_t popWaiting(SpscRing<std::uint32_t>& queue) {
+    std::uint32_t slot;
+    int spins = 0;
+    while (!queue.pop(slot)) backoff(spins);
+    return slot;
+}
+
+}
+
+VideoPipeline::VideoPipeline(const VideoPipelineConfig& config, std::unique_ptr<VideoService> video_service,
+                             std::unique_ptr<CannyEdgeDetection> canny_edge_detector,
+                             std::unique_ptr<HoughTransform> hough_transform,
+                             std::unique_ptr<ParticleFilter> lane_tracker)
+    : config_(config), video_service_(std::move(video_service)), canny_edge_detector_(std::move(canny_edge_detector)),
+      hough_transform_(std::move(hough_transform)), lane_tracker_(std::move(lane_tracker)), line_refiner_(config.pyramid) {}
+
+void VideoPipeline::run(const std::string& video_path) {
+    if (!video_service_->initialize(video_path)) {
+        std::cerr << "Failed to initialize video service." << std::endl;
+        return;
+    }
+    report_start_ = Clock::now();
+    if (config_.threaded) {
+        runThreaded();
+    } else {
+        runSerial();
+    }
+}
+
+void VideoPipeline::runSerial() {
+    frames_.resize(1);
+    PipelineFrame& frame = frames_[0];
+    const Stage order[] = {kDecode, kCanny, kHough, kRender};
+    while (video_service_->hasMoreFrames()) {
+        for (Stage stage : order) {
+            auto start = Clock::now();
+            switch (stage) {
+            case kDecode:
+                if (!decode(frame)) return;
+                break;
+            case kCanny: detectEdges(frame); break;
+            case kHough: detectLines(frame); break;
+            default:
+                render(frame);
+                video_service_->releaseFrame(frame.gray);
+                break;
+            }
+            counters_[stage].busy_ns += nanosecondsSince(start);
+            ++counters_[stage].frames;
+        }
+        report(0);
+    }
+}
+
+// decode -> canny -> hough -> render, with the rendered frames going back to decode.
+// Every queue has a single producer and a single consumer.
+void VideoPipeline::runThreaded() {
+    const size_t depth = static_cast<size_t>(std::max(1, config_.queue_depth));
+    // Enough frames to fill the three stage queues with one more in the hands of each stage
+    const size_t frame_count = 3 * depth + kStageCount;
+    frames_.resize(frame_count);
+
+    Queue free_frames(frame_count);
+    Queue decoded(depth);
+    Queue edged(depth);
+    Queue lined(depth);
+    for (size_t i = 0; i < frame_count; ++i) {
+        free_frames.push(static_cast<std::uint32_t>(i));
+    }
+
+    std::thread decode_thread([&] { decodeLoop(free_frames, decoded); });
+    std::thread canny_thread([&] { stageLoop(kCanny, decoded, edged, [this](PipelineFrame& f) { detectEdges(f); }); });
+    std::thread hough_thread([&] { stageLoop(kHough, edged, lined, [this](PipelineFrame& f) { detectLines(f); }); });
+
+    for (;;) {
+        counters_[kRender].queued += lined.size();
+        const std::uint32_t slot = popWaiting(lined);
+        if (slot == kEndOfStream) break;
+        auto start = Clock::now();
+        render(frames_[slot]);
+        video_service_->releaseFrame(frames_[slot].gray);
+        counters_[kRender].busy_ns += nanosecondsSince(start);
+        ++counters_[kRender].frames;
+        pushWaiting(free_frames, slot);
+        report(depth);
+    }
+
+    decode_thread.join();
+    canny_thread.join();
+    hough_thread.join();
+}
+
+void VideoPipeline::decodeLoop(Queue& free_frames, Queue& decoded) {
+    StageCounters& counters = counters_[kDecode];
+    std::uint32_t slot = kEndOfStream;
+    while (video_service_->hasMoreFrames()) {
+        if (slot == kEndOfStream) slot = popWaiting(free_frames);
+        const auto previous_display = last_display_;
+        auto start = Clock::now();
+        const bool ok = decode(frames_[slot]);
+        counters.busy_ns += nanosecondsSince(start);
+        if (!ok) break;
+        ++counters.frames;
+
+        if (config_.drop_policy == FrameDropPolicy::DropNewest) {
+            // Keep the slot for the next decode
+            if (!decoded.push(slot)) {
+                // A dropped frame is never shown, so the next one may take its display slot
+                last_display_ = previous_display;
+                frames_[slot].draw = false;
+                video_service_->releaseFrame(frames_[slot].gray);
+                ++dropped_;
+                continue;
+            }
+        } else {
+            pushWaiting(decoded, slot);
+        }
+        slot = kEndOfStream;
+    }
+    pushWaiting(decoded, kEndOfStream);
+}
+
+template <typename Work>
+void VideoPipeline::stageLoop(Stage stage, Queue& input, Queue& output, Work&& work) {
+    StageCounters& counters = counters_[stage];
+    for (;;) {
+        counters.queued += input.size();
+        const std::uint32_t slot = popWaiting(input);
+        if (slot == kEndOfStream) break;
+        auto start = Clock::now();
+        work(frames_[slot]);
+        counters.busy_ns += nanosecondsSince(start);
+        ++counters.frames;
+        pushWaiting(output, slot);
+    }
+    pushWaiting(output, kEndOfStream);
+}
+
+// Picks the frames to draw, at most display_max_fps a second, before decoding so that only
+// those get a colour copy
+bool VideoPipeline::decode(PipelineFrame& frame) {
+    frame.draw = config_.display;
+    if (frame.draw && config_.display_max_fps > 0.0) {
+        const auto now = Clock::now();
+        frame.draw = std::chrono::duration<double>(now - last_display_).count() >= 1.0 / config_.display_max_fps;
+        if (frame.draw) last_display_ = now;
+    }
+    return video_service_->getFrame(frame.gray, frame.draw ? &frame.color : nullptr);
+}
+
+void VideoPipeline::detectEdges(PipelineFrame& frame) {
+    const int factor = config_.pyramid.factor;
+    if (factor <= 1) {
+        canny_edge_detector_->run(frame.gray, frame.edges);
+        return;
+    }
+    {
+        CLT_SCOPED_TIMER(Downscale);
+        const int w = frame.gray.width / factor, h = frame.gray.height / factor;
+        if (frame.small.width != w || frame.small.height != h) frame.small = Frame(w, h);
+        downscaleFrame(frame.gray, frame.small, factor);
+    }
+    canny_edge_detector_->run(frame.small, frame.edges);
+}
+
+void VideoPipeline::detectLines(PipelineFrame& frame) {
+    bool tracked = false;
+    if (lane_tracker_) {
+        const TrackedState& state = lane_tracker_->run(frame.edges);
+        tracked = !lane_tracker_->needsFullSearch();
+        if (tracked) {
+            frame.lines.assign({state.left, state.right});
+            frame.segments.clear();
+        }
+    }
+    if (!tracked) {
+        hough_transform_->run(frame.edges);
+        const auto& lines = hough_transform_->getDetectedLines();
+        const auto& segments = hough_transform_->getDetectedSegments();
+        frame.lines.assign(lines.begin(), lines.end());
+        frame.segments.assign(segments.begin(), segments.end());
+        if (lane_tracker_) lane_tracker_->seed(lines, frame.edges.width, frame.edges.height);
+    }
+    if (config_.pyramid.factor > 1) {
+        CLT_SCOPED_TIMER(LineRefine);
+        line_refiner_.refine(frame.gray, hough_transform_->getRoi(), frame.lines, frame.segments);
+    }
+}
+
+// Draws the detections straight onto the decoded colour frame of the frames decode()
+// picked. Lines are clipped to the lower image region the detector looks at.
+void VideoPipeline::render(PipelineFrame& frame) {
+    if (!frame.draw) return;
+    CLT_SCOPED_TIMER(Render);
+
+    if (frame.color.channels() == 3) {
+        canvas_ = frame.color;
+    } else {
+        cv::cvtColor(frame.gray.toMat(), canvas_, cv::COLOR_GRAY2BGR);
+    }
+    // The ROI only changes with the frame size, so the copy is taken while the Hough
+    // thread is working on a frame of the same size and never rewriting it
+    if (roi_.width != canvas_.cols || roi_.height != canvas_.rows) {
+        const RoiSpans& roi = hough_transform_->getRoi();
+        roi_ = roi.width == canvas_.cols ? roi : roi.upscaled(std::max(1, config_.pyramid.factor), canvas_.cols, canvas_.rows);
+    }
+    const cv::Scalar red(0, 0, 255);
+    auto draw = [&](int x0, int y0, int x1, int y1) {
+        cv::Point p0(x0, y0), p1(x1, y1);
+        if (!cv::clipLine(canvas_.size(), p0, p1)) return;
+        if (!clipToRoi(roi_, p0.x, p0.y, p1.x, p1.y)) return;
+        cv::line(canvas_, p0, p1, red, 2, cv::LINE_AA);
+    };
+    if (!frame.segments.empty()) {
+        for (const auto& segment : frame.segments) {
+            draw(segment.x0, segment.y0, segment.x1, segment.y1);
+        }
+    } else {
+        for (const auto& line : frame.lines) {
+            int x0, y0, x1, y1;
+            lineEndpoints(line, canvas_.cols, canvas_.rows, x0, y0, x1, y1);
+            draw(x0, y0, x1, y1);
+        }
+    }
+
+    cv::imshow("Overlay (Hough lines)", canvas_);
+    cv::waitKey(1);
+}
+
+// Busy is the share of wall time a stage spent working, queue the average fill of its
+// input queue. Throughput is capped by the busiest stage.
+void VideoPipeline::report(size_t queue_depth) {
+    const std::uint64_t rendered = counters_[kRender].frames;
+    const int interval = std::max(1, config_.report_interval);
+    if (rendered - reported_frames_[kRender] < static_cast<std::uint64_t>(interval)) return;
+
+    const double wall_ns = static_cast<double>(nanosecondsSince(report_start_));
+    const double fps = (rendered - reported_frames_[kRender]) * 1e9 / wall_ns;
+    std::cout << "FPS: " << fps;
+    for (int stage = 0; stage < kStageCount; ++stage) {
+        const std::uint64_t busy = counters_[stage].busy_ns;
+        const std::uint64_t frames = counters_[stage].frames;
+        const std::uint64_t queued = counters_[stage].queued;
+        const std::uint64_t new_frames = frames - reported_frames_[stage];
+        std::cout << ", " << kStageNames[stage] << " " << static_cast<int>(100.0 * (busy - reported_busy_ns_[stage]) / wall_ns) << "%";
+        if (new_frames > 0) {
+            std::cout << " " << (busy - reported_busy_ns_[stage]) / 1000000.0 / new_frames << "ms";
+        }
+        if (stage != kDecode && queue_depth > 0 && new_frames > 0) {
+            std::cout << " q " << static_cast<double>(queued - reported_queued_[stage]) / new_frames << "/" << queue_depth;
+        }
+        reported_busy_ns_[stage] = busy;
+        reported_frames_[stage] = frames;
+        reported_queued_[stage] = queued;
+    }
+    if (config_.drop_policy == FrameDropPolicy::DropNewest) {
+        std::cout << ", dropped " << dropped_.load();
+    }
+    std::cout << std::endl;
+#if CANNY_LANE_TRACKER_INSTRUMENTATION
+    logMetrics(std::cout, &metric_window_);
+#endif
+    report_start_ = Clock::now();
+}
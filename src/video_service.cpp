@@ -1,36 +1,243 @@
 #include "video_service.h"
+#include "frame_pool.h"
+#include "instrumentation.h"
+#include "spsc_ring.h"
+#include <atomic>
+#include <chrono>
+#include <opencv2/videoio/registry.hpp>
+#include <thread>
 
+namespace {
+
+// Spins briefly, then sleeps, so a waiting prefetch thread does not burn a core
+void backoff(int& spins) {
+    if (++spins < 64) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+constexpr std::uint32_t fourcc(char a, char b, char c, char d) {
+    return std::uint32_t(std::uint8_t(a)) | std::uint32_t(std::uint8_t(b)) << 8 | std::uint32_t(std::uint8_t(c)) << 16 |
+           std::uint32_t(std::uint8_t(d)) << 24;
+}
+
+// Byte of each pixel pair holding Y in packed 4:2:2, by FOURCC: 0 for the YUYV family,
+// 1 for UYVY, -1 for anything else
+int packedLumaChannel(std::uint32_t code) {
+    for (std::uint32_t luma_first : {fourcc('Y', 'U', 'Y', 'V'), fourcc('Y', 'U', 'Y', '2'), fourcc('Y', 'U', 'N', 'V'),
+                                     fourcc('V', '4', '2', '2'), fourcc('Y', 'V', 'Y', 'U')}) {
+        if (code == luma_first) return 0;
+    }
+    for (std::uint32_t chroma_first : {fourcc('U', 'Y', 'V', 'Y'), fourcc('Y', '4', '2', '2'), fourcc('U', 'Y', 'N', 'V'),
+                                       fourcc('H', 'D', 'Y', 'C'), fourcc('2', 'v', 'u', 'y'), fourcc('V', 'Y', 'U', 'Y')}) {
+        if (code == chroma_first) return 1;
+    }
+    return -1;
+}
+
+}
 
 struct VideoServiceImpl : public VideoService {
 
+    VideoServiceConfig config_;
     cv::VideoCapture cap;
     bool initialized = false;
+    std::string video_path_;
+    // Frames read so far, where a reopened capture picks up
+    std::uint64_t frames_read_ = 0;
+    // Channel holding Y in packed 4:2:2 frames, from the FOURCC; -1 when unknown
+    int packed_luma_channel_ = -1;
+    // Picture height from the container. Raw 4:2:0 frames come back with the chroma
+    // planes stacked below the luma, half as many rows again.
+    int frame_height_ = 0;
+    // Decoder output, read() reuses its buffer while the video size stays the same
+    cv::Mat decoded;
+    FramePool pool;
+    // Part of the frame that gets converted, for frames of crop_size_
+    cv::Rect crop_{0, 0, 0, 0};
+    cv::Size crop_size_;
 
-    cv::Mat getFrame() {
+    // Prefetching. The thread decodes into slots taken from free_slots_ and hands them
+    // over through ready_slots_; a slot with an empty view marks the end of the video.
+    struct Prefetched {
+        FrameView gray;
+        cv::Mat color;
+    };
+    std::vector<Prefetched> slots_;
+    std::unique_ptr<SpscRing<std::uint32_t>> free_slots_;
+    std::unique_ptr<SpscRing<std::uint32_t>> ready_slots_;
+    std::thread prefetch_thread_;
+    std::atomic<bool> stop_{false};
+    bool prefetch_color_ = false;
+    bool finished_ = false;
 
-        cv::Mat frame;
-        if (cap.read(frame)) {
-            return frame;
+    explicit VideoServiceImpl(const VideoServiceConfig& config) : config_(config) {}
+
+    ~VideoServiceImpl() override {
+        stop_ = true;
+        if (prefetch_thread_.joinable()) prefetch_thread_.join();
+    }
+
+    bool getFrame(FrameView& frame, cv::Mat* color) override {
+        if (!initialized || finished_) return false;
+        if (config_.prefetch_frames <= 0) return decodeInto(frame, color);
+
+        // The first call decides whether the thread copies colour frames too
+        if (!prefetch_thread_.joinable()) startPrefetch(color != nullptr);
+        std::uint32_t slot;
+        int spins = 0;
+        while (!ready_slots_->pop(slot)) backoff(spins);
+        Prefetched& prefetched = slots_[slot];
+        if (prefetched.gray.empty()) {
+            finished_ = true;
+            return false;
         }
-        return cv::Mat(); // Return an empty frame on failure
+        frame = prefetched.gray;
+        // Trading buffers hands the slot the caller's previous colour frame to decode into
+        if (color) std::swap(*color, prefetched.color);
+        free_slots_->push(slot);
+        return true;
+    }
+
+    void releaseFrame(const FrameView& frame) override {
+        pool.release(frame);
     }
 
-    void releaseFrame(const cv::Mat& frame) {
+    bool initialize(const std::string& video_path) override {
+        video_path_ = video_path;
+        frames_read_ = 0;
+        initialized = config_.luma ? openLuma(video_path) : cap.open(video_path);
         if (initialized) {
+            frame_height_ = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+            packed_luma_channel_ = packedLumaChannel(static_cast<std::uint32_t>(cap.get(cv::CAP_PROP_FOURCC)));
         }
+        return initialized;
     }
 
-    bool initialize(const std::string& video_path) {
-        cap.open(video_path);
-        initialized = cap.isOpened();
-        return initialized;
+    bool hasMoreFrames() override {
+        // cap belongs to the prefetch thread once it runs
+        if (prefetch_thread_.joinable()) return !finished_;
+        return initialized && !finished_ && cap.isOpened();
+    }
+
+    // GStreamer's videoconvert makes GRAY8 by dropping the chroma planes. Other backends
+    // are asked to skip their RGB conversion, where they support it.
+    bool openLuma(const std::string& video_path) {
+        if (cv::videoio_registry::hasBackend(cv::CAP_GSTREAMER)) {
+            const std::string source = video_path.find("://") != std::string::npos
+                                           ? "uridecodebin uri=" + video_path
+                                           : "filesrc location=\"" + video_path + "\" ! decodebin";
+            if (cap.open(source + " ! videoconvert ! video/x-raw,format=GRAY8 ! appsink sync=false", cv::CAP_GSTREAMER)) {
+                return true;
+            }
+        }
+        if (!cap.open(video_path)) return false;
+        cap.set(cv::CAP_PROP_CONVERT_RGB, 0);
+        return true;
+    }
+
+    // BGR, packed 4:2:2 with a FOURCC that says where Y is, grey, or planar 4:2:0 with the
+    // luma plane on top
+    bool knownLayout() const {
+        if (decoded.type() == CV_8UC3) return true;
+        if (decoded.type() == CV_8UC2) return packed_luma_channel_ >= 0;
+        return decoded.type() == CV_8UC1 &&
+               (frame_height_ <= 0 || decoded.rows == frame_height_ || decoded.rows == frame_height_ * 3 / 2);
+    }
+
+    bool read() {
+        CLT_SCOPED_TIMER(Decode);
+        if (!cap.read(decoded) || decoded.empty()) return false;
+        if (!knownLayout()) {
+            // A raw buffer we can't find the luma in. Go back to BGR frames for good, on a
+            // fresh capture moved to this frame so it isn't lost.
+            cap.release();
+            if (!cap.open(video_path_)) return false;
+            if (frames_read_ > 0) cap.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(frames_read_));
+            if (!cap.read(decoded) || decoded.empty() || !knownLayout()) return false;
+        }
+        ++frames_read_;
+        return true;
+    }
+
+    void updateCrop(int width, int height) {
+        if (crop_size_ == cv::Size(width, height)) return;
+        crop_size_ = cv::Size(width, height);
+        crop_ = cv::Rect(0, 0, width, height);
+        if (!config_.crop_to_roi) return;
+        const RoiSpans roi = compileRoi(config_.roi, width, height);
+        int x_begin = width, x_end = 0;
+        for (int y = roi.y_begin; y < roi.y_end; ++y) {
+            const RowSpan& span = roi.row(y);
+            if (span.empty()) continue;
+            x_begin = std::min(x_begin, span.begin);
+            x_end = std::max(x_end, span.end);
+        }
+        if (x_begin >= x_end) return;
+        const int margin = std::max(0, config_.roi_margin);
+        const int x0 = std::max(0, x_begin - margin), x1 = std::min(width, x_end + margin);
+        const int y0 = std::max(0, roi.y_begin - margin), y1 = std::min(height, roi.y_end + margin);
+        crop_ = cv::Rect(x0, y0, x1 - x0, y1 - y0);
     }
 
-    bool hasMoreFrames() {
-        return initialized && cap.isOpened();
+    bool decodeInto(FrameView& frame, cv::Mat* color) {
+        if (!read()) return false;
+        CLT_SCOPED_TIMER(GrayConvert);
+        const bool planar = decoded.type() == CV_8UC1 && frame_height_ > 0 && decoded.rows == frame_height_ * 3 / 2;
+        const int height = planar ? frame_height_ : decoded.rows;
+        frame = pool.acquire(decoded.cols, height);
+        updateCrop(decoded.cols, height);
+        // The destination already has the right size and type, so this converts in place.
+        // The crop lies inside the luma plane of a planar frame.
+        cv::Mat gray = frame.toMat()(crop_);
+        const cv::Mat source = decoded(crop_);
+        switch (decoded.type()) {
+        case CV_8UC3: cv::cvtColor(source, gray, cv::COLOR_BGR2GRAY); break;
+        case CV_8UC2: cv::extractChannel(source, gray, packed_luma_channel_); break;
+        default: source.copyTo(gray); break;
+        }
+        if (color) {
+            if (decoded.channels() == 3) {
+                decoded.copyTo(*color);
+            } else {
+                color->release();
+            }
+        }
+        return true;
+    }
+
+    void startPrefetch(bool color) {
+        prefetch_color_ = color;
+        const size_t depth = static_cast<size_t>(config_.prefetch_frames);
+        slots_.resize(depth);
+        free_slots_ = std::make_unique<SpscRing<std::uint32_t>>(depth);
+        ready_slots_ = std::make_unique<SpscRing<std::uint32_t>>(depth);
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            free_slots_->push(static_cast<std::uint32_t>(i));
+        }
+        prefetch_thread_ = std::thread([this] { prefetchLoop(); });
+    }
+
+    void prefetchLoop() {
+        while (!stop_) {
+            std::uint32_t slot;
+            int spins = 0;
+            while (!free_slots_->pop(slot)) {
+                if (stop_) return;
+                backoff(spins);
+            }
+            Prefetched& prefetched = slots_[slot];
+            const bool ok = decodeInto(prefetched.gray, prefetch_color_ ? &prefetched.color : nullptr);
+            if (!ok) prefetched.gray = FrameView();
+            // The ring holds every slot, so this push can't fail
+            ready_slots_->push(slot);
+            if (!ok) return;
+        }
     }
 };
 
-std::unique_ptr<VideoService> createVideoService() {
-    return std::make_unique<VideoServiceImpl>();
-}
\ No newline at end of file
+std::unique_ptr<VideoService> createVideoService(const VideoServiceConfig& config) {
+    return std::make_unique<VideoServiceImpl>(config);
+}
@@ -0,0 +1,285 @@
+// Self-contained checks of detector properties that a golden file can't pin down, run by
+// CTest on synthetic frames. Each one prints what it measured and exits non-zero on failure.
+//
+//   detector_checks blur      fixed-point Gaussian kernels stay within one level of the float blur
+//   detector_checks pyramid   top lines of pyramid mode run along the painted marking edges
+//   detector_checks tracker   the particle filter stays on the lane markings while locked
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "canny_edge_detection.h"
+#include "canny_kernels.h"
+#include "hough_transform.h"
+#include "particle_filter.h"
+#include "pyramid.h"
+#include "synthetic_lanes.h"
+
+namespace {
+
+// The float blur of CannyEdgeDetection with use_simd off: taps outside the row are
+// dropped, rows are clamped, both passes truncate
+Frame referenceBlur(const Frame& frame, const std::vector<float>& kernel) {
+    const int half = static_cast<int>(kernel.size()) / 2;
+    Frame tmp(frame.width, frame.height), blur(frame.width, frame.height);
+    for (int y = 0; y < frame.height; ++y) {
+        for (int x = 0; x < frame.width; ++x) {
+            float sum = 0.0f;
+            for (int xx = std::max(0, x - half); xx <= std::min(frame.width - 1, x + half); ++xx) {
+                sum += frame.pixels[y * frame.width + xx] * kernel[xx - x + half];
+            }
+            tmp.pixels[y * frame.width + x] = static_cast<uint8_t>(sum);
+        }
+    }
+    for (int y = 0; y < frame.height; ++y) {
+        for (int x = 0; x < frame.width; ++x) {
+            float sum = 0.0f;
+            for (int k = -half; k <= half; ++k) {
+                sum += tmp.pixels[std::clamp(y + k, 0, frame.height - 1) * frame.width + x] * kernel[k + half];
+            }
+            blur.pixels[y * frame.width + x] = static_cast<uint8_t>(sum);
+        }
+    }
+    return blur;
+}
+
+Frame fixedPointBlur(const Frame& frame, const std::vector<int16_t>& weights, const GaussianRowKernels& kernels) {
+    const int size = static_cast<int>(weights.size()), half = size / 2;
+    Frame tmp(frame.width, frame.height), blur(frame.width, frame.height);
+    for (int y = 0; y < frame.height; ++y) {
+        kernels.horizontal(frame.row(y), tmp.row(y), frame.width, weights.data(), size);
+    }
+    std::vector<const uint8_t*> rows(size);
+    for (int y = 0; y < frame.height; ++y) {
+        for (int k = -half; k <= half; ++k) rows[k + half] = tmp.row(std::clamp(y + k, 0, frame.height - 1));
+        kernels.vertical(rows.data(), blur.row(y), frame.width, weights.data(), size);
+    }
+    return blur;
+}
+
+// Noise, ramps of several slopes and directions (wrapping into saw teeth), a flat white
+// frame and a lane scene, through the generic and the size-specialized kernels of every kernel size
+bool checkBlur() {
+    constexpr int kWidth = 333, kHeight = 97;
+    std::vector<std::pair<const char*, Frame>> inputs;
+    std::mt19937 rng(5);
+    Frame noise(kWidth, kHeight);
+    for (auto& pixel : noise.pixels) pixel = static_cast<uint8_t>(rng() & 255);
+    inputs.emplace_back("noise", noise);
+    for (int slope : {1, 2, 3, 5, 7}) {
+        Frame ramp(kWidth, kHeight);
+        for (int y = 0; y < kHeight; ++y) {
+            for (int x = 0; x < kWidth; ++x) ramp.pixels[y * kWidth + x] = static_cast<uint8_t>(x * slope + y * (slope % 3));
+        }
+        inputs.emplace_back("ramp", ramp);
+    }
+    Frame slow_ramp(kWidth, kHeight);
+    for (int y = 0; y < kHeight; ++y) {
+        for (int x = 0; x < kWidth; ++x) slow_ramp.pixels[y * kWidth + x] = static_cast<uint8_t>((x + 2 * y) / 3);
+    }
+    inputs.emplace_back("slow ramp", slow_ramp);
+    Frame white(kWidth, kHeight);
+    std::fill(white.pixels.begin(), white.pixels.end(), 255);
+    inputs.emplace_back("white", white);
+    SyntheticLaneConfig scene;
+    scene.width = kWidth;
+    scene.height = kHeight;
+    scene.clutter = 10;
+    inputs.emplace_back("lanes", makeSyntheticLaneFrame(scene));
+
+    bool ok = true;
+    for (double sigma : {0.4, 0.5, 0.8, 1.0, 1.4, 2.0, 2.5, 3.0, 3.5, 4.0, 5.0}) {
+        const int size = gaussianKernelSize(sigma);
+        const std::vector<float> kernel = gaussianKernel1D(sigma, size);
+        const std::vector<int16_t> weights = quantizeGaussianKernel(kernel);
+        int worst = 0;
+        const char* worst_input = "";
+        for (const auto& input : inputs) {
+            const Frame reference = referenceBlur(input.second, kernel);
+            for (const GaussianRowKernels& kernels : {scalarGaussianRowKernels(), selectGaussianRowKernels(),
+                                                      scalarGaussianRowKernels(size), selectGaussianRowKernels(size)}) {
+                const Frame blur = fixedPointBlur(input.second, weights, kernels);
+                for (size_t i = 0; i < blur.pixels.size(); ++i) {
+                    const int diff = std::abs(blur.pixels[i] - reference.pixels[i]);
+                    if (diff > worst) {
+                        worst = diff;
+                        worst_input = input.first;
+                    }
+                }
+            }
+        }
+        const bool pass = worst <= 1;
+        std::printf("blur sigma %.1f, %d taps: max difference %d%s%s %s\n", sigma, size, worst,
+                    worst > 0 ? " on " : "", worst > 0 ? worst_input : "", pass ? "ok" : "FAIL");
+        ok = ok && pass;
+    }
+    return ok;
+}
+
+// Column of a non-horizontal line at row y
+double columnAt(const HoughLine& line, double y) {
+    return (line.rho - y * std::sin(line.theta)) / std::cos(line.theta);
+}
+
+// Mean column distance over the rows [y0, y1] between line and the left (edge -1) or right
+// (edge 1) grey-level step of a marking. makeSyntheticLaneFrame fills whole pixels from
+// floor(center - half_width) to floor(center + half_width), so the steps sit half a pixel
+// outside those.
+double markingEdgeOffset(const HoughLine& line, const SyntheticLaneConfig& scene, int frame_index, int side,
+                         int edge, int y0, int y1) {
+    double sum = 0.0;
+    for (int y = y0; y <= y1; ++y) {
+        const SyntheticMarking marking = syntheticLaneMarking(scene, frame_index, side, y);
+        const double step = edge < 0 ? std::floor(marking.center - marking.half_width) - 0.5
+                                     : std::floor(marking.center + marking.half_width) + 0.5;
+        sum += std::fabs(columnAt(line, y) - step);
+    }
+    return sum / (y1 - y0 + 1);
+}
+
+std::vector<HoughLine> detectLines(const FrameView& frame, int factor) {
+    CannyEdgeConfig canny_config;
+    canny_config.skip_blur_border = factor > 1;
+    auto canny = createCannyEdgeDetection(canny_config);
+    auto hough = createHoughTransform();
+    PyramidConfig pyramid;
+    pyramid.factor = factor;
+    LineRefiner refiner(pyramid);
+    Edges edges;
+    if (factor > 1) {
+        Frame small(frame.width / factor, frame.height / factor);
+        downscaleFrame(frame, small, factor);
+        canny->run(small, edges);
+    } else {
+        canny->run(frame, edges);
+    }
+    hough->run(edges);
+    std::vector<HoughLine> lines = hough->getDetectedLines();
+    std::vector<HoughSegment> segments;
+    if (factor > 1) refiner.refine(frame, hough->getRoi(), lines, segments);
+    return lines;
+}
+
+// On 4K frames, both grey-level steps of both markings have a line among the top pyramid
+// lines, on average within kTolerance of the painted step over the ROI rows, and none of
+// those lines runs along the frame border. Full-resolution Hough is printed for comparison:
+// its whole-degree thetas leave it about 3 px off.
+bool checkPyramid() {
+    constexpr int kTopLines = 5;
+    constexpr double kTolerance = 0.8;
+    constexpr double kBorder = 32.0;
+    bool ok = true;
+    for (int clutter : {0, 40}) {
+        for (int frame_index : {0, 10}) {
+            SyntheticLaneConfig scene;
+            scene.width = 3840;
+            scene.height = 2160;
+            scene.clutter = clutter;
+            Frame frame = makeSyntheticLaneFrame(scene, frame_index);
+            // Rows of the default ROI, the lower half
+            const int y0 = static_cast<int>(frame.height * 0.55), y1 = static_cast<int>(frame.height * 0.95);
+            for (int factor : {1, 2, 4}) {
+                const std::vector<HoughLine> lines = detectLines(frame, factor);
+                const int top = std::min(kTopLines, static_cast<int>(lines.size()));
+                // Worst over the four steps of the best line on each, infinite when one has none
+                double worst = 0.0;
+                for (int side : {-1, 1}) {
+                    for (int edge : {-1, 1}) {
+                        double best = INFINITY;
+                        for (int i = 0; i < top; ++i) {
+                            // Lines along the left marking have theta above 0
+                            if ((lines[i].theta > 0.0 ? -1 : 1) != side) continue;
+                            best = std::min(best, markingEdgeOffset(lines[i], scene, frame_index, side, edge, y0, y1));
+                        }
+                        worst = std::max(worst, best);
+                    }
+                }
+                bool border = false;
+                for (int i = 0; i < top; ++i) {
+                    const double x0 = columnAt(lines[i], y0), x1 = columnAt(lines[i], y1);
+                    border = border || std::max(x0, x1) < kBorder || std::min(x0, x1) > frame.width - kBorder;
+                }
+                const char* missing = std::isinf(worst) ? ", a marking edge has no line" : "";
+                if (factor == 1) {
+                    std::printf("full resolution clutter %d frame %d: worst marking edge offset %.2f px%s\n", clutter,
+                                frame_index, worst, missing);
+                    continue;
+                }
+                const bool pass = worst <= kTolerance && !border;
+                std::printf("pyramid clutter %d frame %d factor %d: worst marking edge offset %.2f px%s%s %s\n", clutter,
+                            frame_index, factor, worst, missing, border ? ", line on the border" : "", pass ? "ok" : "FAIL");
+                ok = ok && pass;
+            }
+        }
+    }
+    return ok;
+}
+
+// Runs the tracker the way VideoPipeline does over a drifting lane, reseeding from the Hough
+// lines whenever it asks for a full search. On every locked frame, both boundaries have to
+// run along their painted markings on the top and bottom ROI rows; either side of a marking
+// will do. The lane moves up to 0.4% of the width per frame, more than the random walk covers
+// at 4K, and the right marking is dashed.
+bool checkTracker() {
+    constexpr int kFrames = 120;
+    constexpr double kTolerance = 8.0;
+    constexpr double kMinLocked = 0.75;
+    bool ok = true;
+    for (int width : {1920, 3840}) {
+        for (int clutter : {0, 40}) {
+            SyntheticLaneConfig scene;
+            scene.width = width;
+            scene.height = width * 9 / 16;
+            scene.clutter = clutter;
+            auto canny = createCannyEdgeDetection();
+            auto hough = createHoughTransform();
+            auto tracker = createParticleFilter();
+            Edges edges;
+            int locked = 0;
+            double worst = 0.0;
+            for (int frame_index = 0; frame_index < kFrames; ++frame_index) {
+                Frame frame = makeSyntheticLaneFrame(scene, frame_index);
+                canny->run(frame, edges);
+                const TrackedState& state = tracker->run(edges);
+                if (state.locked) {
+                    ++locked;
+                    for (int side : {-1, 1}) {
+                        const HoughLine& line = side < 0 ? state.left : state.right;
+                        // Rows of the default ROI, the lower half
+                        for (int y : {scene.height / 2, scene.height - 1}) {
+                            const SyntheticMarking marking = syntheticLaneMarking(scene, frame_index, side, y);
+                            const double off = std::fabs(columnAt(line, y) - marking.center) - marking.half_width;
+                            worst = std::max(worst, off);
+                        }
+                    }
+                }
+                if (tracker->needsFullSearch()) {
+                    hough->run(edges);
+                    tracker->seed(hough->getDetectedLines(), edges.width, edges.height);
+                }
+            }
+            const double share = static_cast<double>(locked) / kFrames;
+            const bool pass = worst <= kTolerance && share >= kMinLocked;
+            std::printf("tracker %dx%d clutter %d: locked on %.0f%% of frames, worst distance to a marking %.1f px %s\n",
+                        scene.width, scene.height, clutter, 100.0 * share, worst, pass ? "ok" : "FAIL");
+            ok = ok && pass;
+        }
+    }
+    return ok;
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: detector_checks blur|pyramid|tracker\n");
+        return 2;
+    }
+    if (std::strcmp(argv[1], "blur") == 0) return checkBlur() ? 0 : 1;
+    if (std::strcmp(argv[1], "pyramid") == 0) return checkPyramid() ? 0 : 1;
+    if (std::strcmp(argv[1], "tracker") == 0) return checkTracker() ? 0 : 1;
+    std::fprintf(stderr, "unknown check %s\n", argv[1]);
+    return 2;
+}
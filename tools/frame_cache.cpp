@@ -0,0 +1,130 @@
+// Decodes a video once into a frame cache and replays caches through Canny and Hough, so
+// detector throughput can be measured without the decoder.
+//
+//   frame_cache record <video> <cache.frames> [--rows top bottom] [--luma]
+//   frame_cache replay <cache.frames> [repeat]
+//
+// --rows keeps only the rows between top and bottom, in fractions of the frame height,
+// grown by kRowMargin rows for the blur. Replay runs the default detectors, whose ROI is
+// the lower half, so --rows 0.5 1.0 is enough for them. The app and batch mode also take
+// .frames files in place of videos.
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include "canny_edge_detection.h"
+#include "frame_cache.h"
+#include "hough_transform.h"
+#include "video_service.h"
+
+namespace {
+
+constexpr int kRowMargin = 16;
+
+using Clock = std::chrono::steady_clock;
+
+int record(const std::string& video_path, const std::string& cache_path, double top, double bottom, bool luma) {
+    VideoServiceConfig video_config;
+    video_config.luma = luma;
+    auto video_service = createVideoService(video_config);
+    if (!video_service->initialize(video_path)) {
+        std::cerr << "Failed to open " << video_path << std::endl;
+        return 1;
+    }
+    FrameCacheWriter writer;
+    FrameView frame;
+    bool opened = false;
+    while (video_service->hasMoreFrames() && video_service->getFrame(frame)) {
+        if (!opened) {
+            const int y_begin = static_cast<int>(std::floor(top * frame.height)) - kRowMargin;
+            const int y_end = static_cast<int>(std::ceil(bottom * frame.height)) + kRowMargin;
+            if (!writer.open(cache_path, frame.width, frame.height, y_begin, y_end)) {
+                std::cerr << "Failed to create " << cache_path << std::endl;
+                return 1;
+            }
+            opened = true;
+        }
+        const bool written = writer.write(frame);
+        video_service->releaseFrame(frame);
+        if (!written) {
+            std::cerr << "Failed to write frame " << writer.frames() << ", the size may have changed" << std::endl;
+            break;
+        }
+    }
+    if (!opened || !writer.close()) {
+        std::cerr << "No frames written to " << cache_path << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << writer.frames() << " frames to " << cache_path << std::endl;
+    return 0;
+}
+
+int replay(const std::string& cache_path, int repeat) {
+    FrameCacheConfig cache_config;
+    cache_config.repeat = repeat;
+    auto video_service = createFrameCacheVideoService(cache_config);
+    if (!video_service->initialize(cache_path)) {
+        std::cerr << "Failed to open " << cache_path << ", not a frame cache?" << std::endl;
+        return 1;
+    }
+    auto canny = createCannyEdgeDetection();
+    auto hough = createHoughTransform();
+    Edges edges;
+    size_t frames = 0;
+    double canny_ms = 0.0, hough_ms = 0.0;
+    const auto begin = Clock::now();
+    FrameView frame;
+    while (video_service->hasMoreFrames() && video_service->getFrame(frame)) {
+        const auto start = Clock::now();
+        canny->run(frame, edges);
+        const auto middle = Clock::now();
+        hough->run(edges);
+        const auto end = Clock::now();
+        video_service->releaseFrame(frame);
+        canny_ms += std::chrono::duration<double, std::milli>(middle - start).count();
+        hough_ms += std::chrono::duration<double, std::milli>(end - middle).count();
+        ++frames;
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    if (frames == 0) {
+        std::cerr << cache_path << " holds no frames" << std::endl;
+        return 1;
+    }
+    std::cout << frames << " frames in " << seconds << "s, " << frames / seconds << " fps, canny "
+              << canny_ms / frames << " ms, hough " << hough_ms / frames << " ms per frame" << std::endl;
+    return 0;
+}
+
+int usage() {
+    std::cerr << "usage: frame_cache record <video> <cache.frames> [--rows top bottom] [--luma]\n"
+                 "       frame_cache replay <cache.frames> [repeat]" << std::endl;
+    return 2;
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) return usage();
+    const std::string mode = argv[1];
+    if (mode == "record") {
+        if (argc < 4) return usage();
+        double top = 0.0, bottom = 1.0;
+        bool luma = false;
+        for (int i = 4; i < argc; ++i) {
+            const std::string option = argv[i];
+            if (option == "--rows" && i + 2 < argc) {
+                top = std::stod(argv[++i]);
+                bottom = std::stod(argv[++i]);
+            } else if (option == "--luma") {
+                luma = true;
+            } else {
+                return usage();
+            }
+        }
+        return record(argv[2], argv[3], top, bottom, luma);
+    }
+    if (mode == "replay") {
+        return replay(argv[2], argc > 3 ? std::max(1, std::stoi(argv[3])) : 1);
+    }
+    return usage();
+}
@@ -0,0 +1,275 @@
+// Replays frames through Canny and Hough and records, or checks against, a golden file
+// holding a hash of every edge map and the detected lines.
+//
+//   golden_replay record <golden> [video]
+//   golden_replay check <golden> [video] [--rho-tol px] [--theta-tol deg] [--votes-tol fraction]
+//                                        [--edge-tol fraction] [--max-slowdown fraction]
+//                                        [--canny-threads n] [--untiled]
+//
+// --canny-threads and --untiled change how Canny runs but not what it finds, so a check
+// with either one against the same golden file shows the edge maps are bit-for-bit equal.
+// Without a video, a fixed set of synthetic lane frames is used. check exits non-zero when
+// an edge map or a line differs beyond the tolerances, or when --max-slowdown is given and
+// the run is that much slower than the recorded timing. Timing deltas are always printed.
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "canny_edge_detection.h"
+#include "hough_transform.h"
+#include "synthetic_lanes.h"
+#include "video_service.h"
+
+namespace {
+
+constexpr int kFormatVersion = 1;
+constexpr int kSyntheticFrames = 12;
+
+struct FrameResult {
+    size_t edge_pixels = 0;
+    uint64_t edge_hash = 0;
+    std::vector<HoughLine> lines;
+};
+
+struct Replay {
+    std::vector<FrameResult> frames;
+    double canny_ms = 0.0; // mean per frame
+    double hough_ms = 0.0;
+};
+
+struct Tolerances {
+    double rho = 1.0;
+    double theta_deg = 1.0;
+    double votes = 0.05;
+    double edges = 0.0;
+    double max_slowdown = -1.0; // negative: timing never fails the check
+};
+
+using Clock = std::chrono::steady_clock;
+
+// FNV-1a over the edge map rows
+uint64_t hashEdges(const FrameView& edges) {
+    uint64_t hash = 1469598103934665603ull;
+    for (int y = 0; y < edges.height; ++y) {
+        const uint8_t* row = edges.row(y);
+        for (int x = 0; x < edges.width; ++x) {
+            hash = (hash ^ row[x]) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+Replay replay(const std::string& video_path, const CannyEdgeConfig& canny_config) {
+    auto canny = createCannyEdgeDetection(canny_config);
+    auto hough = createHoughTransform();
+    Replay result;
+    Frame edge_map(0, 0);
+
+    auto process = [&](const FrameView& frame) {
+        if (edge_map.width != frame.width || edge_map.height != frame.height) {
+            edge_map = Frame(frame.width, frame.height);
+        }
+        auto start = Clock::now();
+        canny->run(frame, FrameView(edge_map));
+        auto middle = Clock::now();
+        hough->run(FrameView(edge_map));
+        auto end = Clock::now();
+        result.canny_ms += std::chrono::duration<double, std::milli>(middle - start).count();
+        result.hough_ms += std::chrono::duration<double, std::milli>(end - middle).count();
+
+        FrameResult frame_result;
+        frame_result.edge_pixels = canny->getStats().edge_pixels;
+        frame_result.edge_hash = hashEdges(edge_map);
+        frame_result.lines = hough->getDetectedLines();
+        result.frames.push_back(frame_result);
+    };
+
+    if (video_path.empty()) {
+        // Clean, cluttered and busy frames at two resolutions
+        for (int i = 0; i < kSyntheticFrames; ++i) {
+            SyntheticLaneConfig scene;
+            scene.clutter = (i % 3) * 60;
+            if (i >= kSyntheticFrames / 2) {
+                scene.width = 1280;
+                scene.height = 720;
+            }
+            scene.seed = 7;
+            Frame frame = makeSyntheticLaneFrame(scene, i * 5);
+            process(frame);
+        }
+    } else {
+        auto video_service = createVideoService();
+        if (!video_service->initialize(video_path)) {
+            std::cerr << "Failed to open " << video_path << std::endl;
+            return result;
+        }
+        FrameView frame;
+        while (video_service->hasMoreFrames() && video_service->getFrame(frame)) {
+            process(frame);
+            video_service->releaseFrame(frame);
+        }
+    }
+    if (!result.frames.empty()) {
+        result.canny_ms /= result.frames.size();
+        result.hough_ms /= result.frames.size();
+    }
+    return result;
+}
+
+bool writeGolden(const std::string& path, const Replay& replay) {
+    std::ofstream out(path);
+    out.precision(9);
+    out << "golden_replay " << kFormatVersion << "\n";
+    out << "timing_ms " << replay.canny_ms << " " << replay.hough_ms << "\n";
+    for (size_t i = 0; i < replay.frames.size(); ++i) {
+        const FrameResult& frame = replay.frames[i];
+        out << "frame " << i << " " << frame.edge_pixels << " " << std::hex << frame.edge_hash << std::dec << " "
+            << frame.lines.size() << "\n";
+        for (const auto& line : frame.lines) {
+            out << "line " << line.votes << " " << line.rho << " " << line.theta << "\n";
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+bool readGolden(const std::string& path, Replay& replay) {
+    std::ifstream in(path);
+    std::string tag;
+    int version = 0;
+    if (!(in >> tag >> version) || tag != "golden_replay" || version != kFormatVersion) return false;
+    if (!(in >> tag >> replay.canny_ms >> replay.hough_ms) || tag != "timing_ms") return false;
+    size_t index, line_count;
+    FrameResult frame;
+    while (in >> tag >> index >> frame.edge_pixels >> std::hex >> frame.edge_hash >> std::dec >> line_count) {
+        if (tag != "frame" || index != replay.frames.size()) return false;
+        frame.lines.resize(line_count);
+        for (auto& line : frame.lines) {
+            if (!(in >> tag >> line.votes >> line.rho >> line.theta) || tag != "line") return false;
+        }
+        replay.frames.push_back(frame);
+    }
+    return in.eof();
+}
+
+bool sameLine(const HoughLine& a, const HoughLine& b, const Tolerances& tol) {
+    return std::abs(a.rho - b.rho) <= tol.rho && std::abs(a.theta - b.theta) * 180.0 / CV_PI <= tol.theta_deg &&
+           std::abs(a.votes - b.votes) <= tol.votes * std::max(a.votes, b.votes);
+}
+
+// Every golden line needs a distinct match in the current lines and vice versa. Near-equal
+// peaks may swap places, so the match ignores order.
+bool linesMatch(const std::vector<HoughLine>& golden, const std::vector<HoughLine>& current, const Tolerances& tol) {
+    if (golden.size() != current.size()) return false;
+    std::vector<bool> used(current.size(), false);
+    for (const auto& expected : golden) {
+        bool found = false;
+        for (size_t i = 0; i < current.size() && !found; ++i) {
+            if (!used[i] && sameLine(expected, current[i], tol)) {
+                used[i] = true;
+                found = true;
+            }
+        }
+        if (!found) return false;
+    }
+    return true;
+}
+
+int check(const Replay& golden, const Replay& current, const Tolerances& tol) {
+    int failures = 0;
+    if (golden.frames.size() != current.frames.size()) {
+        std::cout << "Frame count differs: golden " << golden.frames.size() << ", now " << current.frames.size() << std::endl;
+        return 1;
+    }
+    size_t exact_edges = 0;
+    for (size_t i = 0; i < golden.frames.size(); ++i) {
+        const FrameResult& expected = golden.frames[i];
+        const FrameResult& actual = current.frames[i];
+        if (expected.edge_hash == actual.edge_hash) {
+            ++exact_edges;
+        } else {
+            const double diff = std::abs(static_cast<double>(expected.edge_pixels) - static_cast<double>(actual.edge_pixels));
+            const bool within = tol.edges > 0.0 && diff <= tol.edges * std::max<size_t>(1, expected.edge_pixels);
+            std::cout << "frame " << i << ": edge map differs, " << expected.edge_pixels << " -> " << actual.edge_pixels
+                      << " edge pixels" << (within ? " (within tolerance)" : "") << std::endl;
+            if (!within) ++failures;
+        }
+        if (!linesMatch(expected.lines, actual.lines, tol)) {
+            std::cout << "frame " << i << ": lines differ" << std::endl;
+            for (const auto& line : expected.lines) {
+                std::cout << "  golden " << line.votes << " " << line.rho << " " << line.theta << std::endl;
+            }
+            for (const auto& line : actual.lines) {
+                std::cout << "  now    " << line.votes << " " << line.rho << " " << line.theta << std::endl;
+            }
+            ++failures;
+        }
+    }
+
+    auto delta = [](double before, double after) { return before > 0.0 ? (after - before) / before : 0.0; };
+    const double canny_delta = delta(golden.canny_ms, current.canny_ms);
+    const double hough_delta = delta(golden.hough_ms, current.hough_ms);
+    const double total_delta = delta(golden.canny_ms + golden.hough_ms, current.canny_ms + current.hough_ms);
+    std::cout << golden.frames.size() << " frames, " << exact_edges << " identical edge maps, " << failures << " failures"
+              << std::endl;
+    std::cout << "canny " << golden.canny_ms << " -> " << current.canny_ms << " ms (" << std::showpos << 100.0 * canny_delta
+              << "%), hough " << std::noshowpos << golden.hough_ms << " -> " << current.hough_ms << " ms (" << std::showpos
+              << 100.0 * hough_delta << "%)" << std::noshowpos << std::endl;
+    if (tol.max_slowdown >= 0.0 && total_delta > tol.max_slowdown) {
+        std::cout << "Slower than the baseline by more than " << 100.0 * tol.max_slowdown << "%" << std::endl;
+        ++failures;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || (std::string(argv[1]) != "record" && std::string(argv[1]) != "check")) {
+        std::cerr << "usage: golden_replay record|check <golden> [video] [--rho-tol px] [--theta-tol deg]"
+                     " [--votes-tol fraction] [--edge-tol fraction] [--max-slowdown fraction]"
+                     " [--canny-threads n] [--untiled]" << std::endl;
+        return 2;
+    }
+    const std::string mode = argv[1];
+    const std::string golden_path = argv[2];
+    std::string video_path;
+    Tolerances tol;
+    CannyEdgeConfig canny_config;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() { return i + 1 < argc ? std::stod(argv[++i]) : 0.0; };
+        if (arg == "--rho-tol") tol.rho = value();
+        else if (arg == "--theta-tol") tol.theta_deg = value();
+        else if (arg == "--votes-tol") tol.votes = value();
+        else if (arg == "--edge-tol") tol.edges = value();
+        else if (arg == "--max-slowdown") tol.max_slowdown = value();
+        else if (arg == "--canny-threads") canny_config.threads = static_cast<int>(value());
+        else if (arg == "--untiled") canny_config.tiled = false;
+        else video_path = arg;
+    }
+
+    Replay current = replay(video_path, canny_config);
+    if (current.frames.empty()) {
+        std::cerr << "No frames replayed" << std::endl;
+        return 2;
+    }
+    if (mode == "record") {
+        if (!writeGolden(golden_path, current)) {
+            std::cerr << "Failed to write " << golden_path << std::endl;
+            return 2;
+        }
+        std::cout << "Recorded " << current.frames.size() << " frames to " << golden_path << std::endl;
+        return 0;
+    }
+
+    Replay golden;
+    if (!readGolden(golden_path, golden)) {
+        std::cerr << "Failed to read " << golden_path << std::endl;
+        return 2;
+    }
+    return check(golden, current, tol);
+}
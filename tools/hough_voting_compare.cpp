@@ -0,0 +1,122 @@
+// Runs full and gradient-oriented Hough voting side by side on a recorded clip and
+// reports how often the detected lines agree and how many accumulator writes each mode did.
+//
+//   hough_voting_compare [video] [window]
+//   hough_voting_compare --synthetic [window]
+//
+// The video defaults to video_file from ../config/main.yaml. --synthetic runs on 60
+// generated 1280x720 road frames instead, with a drifting lane and growing clutter.
+#include <iostream>
+#include <cmath>
+#include <yaml-cpp/yaml.h>
+#include <opencv2/opencv.hpp>
+#include "video_service.h"
+#include "canny_edge_detection.h"
+#include "hough_transform.h"
+#include "synthetic_lanes.h"
+
+// Lines within this distance in (rho, theta) count as the same detection
+constexpr double kRhoTolerance = 3.0;
+constexpr double kThetaToleranceDeg = 2.0;
+constexpr int kSyntheticFrames = 60;
+
+static bool sameLine(const HoughLine& a, const HoughLine& b) {
+    return std::abs(a.rho - b.rho) <= kRhoTolerance &&
+           std::abs(a.theta - b.theta) * 180.0 / CV_PI <= kThetaToleranceDeg;
+}
+
+int main(int argc, char** argv) {
+    std::string video_path;
+    if (argc > 1) {
+        video_path = argv[1];
+    } else {
+        YAML::Node config = YAML::LoadFile("../config/main.yaml");
+        video_path = config["video_file"].as<std::string>();
+    }
+
+    CannyEdgeConfig canny_config;
+    canny_config.edge_directions = true;
+    HoughTransformConfig full_config;
+    HoughTransformConfig oriented_config;
+    oriented_config.orientedVoting = true;
+    if (argc > 2) {
+        oriented_config.orientedVotingWindow = std::stoi(argv[2]);
+    }
+
+    auto canny = createCannyEdgeDetection(canny_config);
+    auto full = createHoughTransform(full_config);
+    auto oriented = createHoughTransform(oriented_config);
+
+    Edges edges;
+    size_t frames = 0, full_lines = 0, matched_lines = 0, identical_frames = 0;
+    size_t full_votes = 0, oriented_votes = 0;
+    double rho_error = 0.0, theta_error = 0.0;
+
+    auto compare = [&](const FrameView& frame) {
+        canny->run(frame, edges);
+        full->run(edges);
+        oriented->run(edges);
+        full_votes += full->getStats().votes_cast;
+        oriented_votes += oriented->getStats().votes_cast;
+
+        bool identical = true;
+        const auto& expected = full->getDetectedLines();
+        const auto& actual = oriented->getDetectedLines();
+        for (size_t i = 0; i < expected.size(); ++i) {
+            if (expected[i].votes <= 0) continue;
+            ++full_lines;
+            identical = identical && i < actual.size() && expected[i].rho == actual[i].rho &&
+                        expected[i].theta == actual[i].theta;
+            for (const auto& line : actual) {
+                if (line.votes > 0 && sameLine(expected[i], line)) {
+                    ++matched_lines;
+                    rho_error += std::abs(expected[i].rho - line.rho);
+                    theta_error += std::abs(expected[i].theta - line.theta) * 180.0 / CV_PI;
+                    break;
+                }
+            }
+        }
+        identical_frames += identical;
+        ++frames;
+    };
+
+    if (video_path == "--synthetic") {
+        for (int i = 0; i < kSyntheticFrames; ++i) {
+            SyntheticLaneConfig scene;
+            scene.width = 1280;
+            scene.height = 720;
+            scene.clutter = i;
+            Frame frame = makeSyntheticLaneFrame(scene, i * 3);
+            compare(frame);
+        }
+    } else {
+        auto video_service = createVideoService();
+        if (!video_service->initialize(video_path)) {
+            std::cerr << "Failed to open " << video_path << std::endl;
+            return 1;
+        }
+        while (video_service->hasMoreFrames()) {
+            FrameView frame;
+            if (!video_service->getFrame(frame)) break;
+            compare(frame);
+            video_service->releaseFrame(frame);
+        }
+    }
+
+    if (frames == 0) {
+        std::cerr << "No frames decoded from " << video_path << std::endl;
+        return 1;
+    }
+    std::cout << "Frames: " << frames << ", oriented window: +-" << oriented_config.orientedVotingWindow << " bins" << std::endl;
+    std::cout << "Identical top lines: " << 100.0 * identical_frames / frames << "% of frames" << std::endl;
+    std::cout << "Matched lines: " << matched_lines << "/" << full_lines
+              << " (" << (full_lines ? 100.0 * matched_lines / full_lines : 100.0) << "%)" << std::endl;
+    if (matched_lines > 0) {
+        std::cout << "Mean error on matches: rho " << rho_error / matched_lines << " px, theta "
+                  << theta_error / matched_lines << " deg" << std::endl;
+    }
+    std::cout << "Accumulator writes per frame: full " << full_votes / frames << ", oriented "
+              << oriented_votes / frames << " (" << (oriented_votes ? double(full_votes) / oriented_votes : 0.0)
+              << "x fewer)" << std::endl;
+    return 0;
+}